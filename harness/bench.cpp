@@ -0,0 +1,205 @@
+// Per-sample process() microbenchmarks.
+//
+// Drives each module's process() in a tight loop over representative
+// parameter sweeps and reports mean ns/sample, cycles/sample and the worst
+// block time against the real-time budget of that block.
+//
+//   make -C harness bench
+//   harness/benchmark --csv > bench.csv
+#include "harness.hpp"
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+struct BenchCase {
+	std::string name;
+	std::string slug;
+	// Param settings by configured name
+	std::vector<std::pair<std::string, float>> params;
+	// Seconds to run before measuring, so grain populations reach steady state
+	float warmup = 0.f;
+};
+
+struct BenchResult {
+	double nsPerSample;
+	double cyclesPerSample;
+	double maxBlockUs;
+	double budgetUs;
+};
+
+static uint64_t readCycles() {
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static std::vector<BenchCase> getCases() {
+	std::vector<BenchCase> cases;
+
+	cases.push_back({"basic", "BasicModule", {{"Pitch", 0.5f}}});
+	for (float wave : {0.f, 0.5f, 0.9f}) {
+		cases.push_back({string::f("basic2 wave=%.1f", wave), "BasicModule2", {{"Waveform Type", wave}}});
+	}
+
+	// Live grains are roughly density x size in free mode
+	struct GrainSetting {
+		int grains;
+		float density;
+		float size;
+	};
+	for (GrainSetting g : {GrainSetting{1, 1.f, 1.f}, {16, 20.f, 0.8f}, {64, 80.f, 0.8f}, {128, 100.f, 1.28f}}) {
+		for (float shape : {0.f, 1.f}) {
+			cases.push_back({string::f("granular grains=%d shape=%.0f", g.grains, shape), "granular", {
+				{"Grain Density", g.density},
+				{"Grain Size", g.size},
+				{"Envelope Shape", shape},
+			}, g.size + 0.1f});
+		}
+		cases.push_back({string::f("granular grains=%d rand", g.grains), "granular", {
+			{"Grain Density", g.density},
+			{"Grain Size", g.size},
+			{"Randomise Pitch", 0.5f},
+			{"Randomise Position", 0.5f},
+			{"Randomise Shape", 0.5f},
+		}, g.size + 0.1f});
+	}
+	return cases;
+}
+
+static bool runCase(const BenchCase& bc, const std::string& samplePath, float sampleRate, float seconds, int blockSize, BenchResult& result) {
+	Model* model = findModel(bc.slug);
+	if (!model) {
+		std::fprintf(stderr, "unknown module %s\n", bc.slug.c_str());
+		return false;
+	}
+
+	Module* module = model->createModule();
+	module->onSampleRateChange({sampleRate, 1.f / sampleRate});
+	module->onAdd({});
+	for (const auto& p : bc.params) {
+		int id = findParam(module, p.first);
+		if (id < 0) {
+			std::fprintf(stderr, "%s has no param '%s'\n", bc.slug.c_str(), p.first.c_str());
+			delete module;
+			return false;
+		}
+		module->params[id].setValue(p.second);
+	}
+	if (bc.slug == "granular") {
+		ModuleWidget* widget = model->createModuleWidget(module);
+		dropFiles(widget, {samplePath});
+		delete widget;
+	}
+
+	Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f / sampleRate;
+	args.frame = 0;
+
+	int64_t warmupFrames = (int64_t)(bc.warmup * sampleRate);
+	for (int64_t i = 0; i < warmupFrames; i++) {
+		module->process(args);
+		args.frame++;
+	}
+
+	int64_t blocks = std::max<int64_t>(1, (int64_t)(seconds * sampleRate) / blockSize);
+	double maxBlock = 0.0;
+	volatile float sink = 0.f;
+
+	uint64_t cyclesStart = readCycles();
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t b = 0; b < blocks; b++) {
+		auto blockStart = std::chrono::steady_clock::now();
+		for (int i = 0; i < blockSize; i++) {
+			module->process(args);
+			args.frame++;
+		}
+		sink = sink + module->outputs[0].getVoltage();
+		double blockTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - blockStart).count();
+		maxBlock = std::max(maxBlock, blockTime);
+	}
+	double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	uint64_t cycles = readCycles() - cyclesStart;
+
+	double samples = (double)blocks * blockSize;
+	result.nsPerSample = total * 1e9 / samples;
+	result.cyclesPerSample = cycles / samples;
+	result.maxBlockUs = maxBlock * 1e6;
+	result.budgetUs = blockSize / sampleRate * 1e6;
+
+	module->onRemove({});
+	delete module;
+	return true;
+}
+
+static std::string makeBenchSample(float sampleRate) {
+	// 10 s of a harmonically rich tone with noise, so grain reads see real data
+	std::vector<float> frames((size_t)(sampleRate * 10.f));
+	float phase = 0.f;
+	for (size_t i = 0; i < frames.size(); i++) {
+		phase += 110.f / sampleRate;
+		phase -= std::floor(phase);
+		frames[i] = 0.5f * std::sin(2.f * (float)M_PI * phase) + 0.25f * (2.f * phase - 1.f) + 0.1f * (random::uniform() - 0.5f);
+	}
+	std::string dir = asset::user("");
+	system::createDirectories(dir);
+	std::string path = system::join(dir, "bench.wav");
+	writeWav(path, frames, 1, (unsigned int)sampleRate);
+	return path;
+}
+
+int main(int argc, char** argv) {
+	float sampleRate = 48000.f;
+	float seconds = 5.f;
+	int blockSize = 256;
+	bool csv = false;
+	std::string filter;
+	std::string samplePath;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--csv") csv = true;
+		else if (arg == "--rate" && hasValue) sampleRate = std::atof(argv[++i]);
+		else if (arg == "--seconds" && hasValue) seconds = std::atof(argv[++i]);
+		else if (arg == "--block" && hasValue) blockSize = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--filter" && hasValue) filter = argv[++i];
+		else if (arg == "--sample" && hasValue) samplePath = argv[++i];
+		else {
+			std::fprintf(stderr,
+				"usage: benchmark [--csv] [--rate <hz>] [--seconds <s>] [--block <frames>]\n"
+				"                 [--filter <substring>] [--sample <file.wav>]\n");
+			return 1;
+		}
+	}
+
+	initHarness(sampleRate, 1);
+	if (samplePath.empty()) {
+		samplePath = makeBenchSample(sampleRate);
+	}
+
+	if (csv) {
+		std::printf("case,ns_per_sample,cycles_per_sample,max_block_us,block_budget_us\n");
+	}
+	else {
+		std::printf("%-34s %12s %14s %14s %10s\n", "case", "ns/sample", "cycles/sample", "max block us", "budget %");
+	}
+
+	for (const BenchCase& bc : getCases()) {
+		if (!filter.empty() && bc.name.find(filter) == std::string::npos) continue;
+		BenchResult r;
+		if (!runCase(bc, samplePath, sampleRate, seconds, blockSize, r)) return 1;
+		if (csv) {
+			std::printf("%s,%.2f,%.1f,%.2f,%.2f\n", bc.name.c_str(), r.nsPerSample, r.cyclesPerSample, r.maxBlockUs, r.budgetUs);
+		}
+		else {
+			std::printf("%-34s %12.2f %14.1f %14.2f %9.2f%%\n", bc.name.c_str(), r.nsPerSample, r.cyclesPerSample, r.maxBlockUs, 100.0 * r.maxBlockUs / r.budgetUs);
+		}
+		std::fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,85 @@
+#include "harness.hpp"
+#include "sample.hpp"
+
+#include "dr_wav.h"
+#include <climits>
+#include <future>
+
+Plugin* pluginInstance = NULL;
+
+void initHarness(float sampleRate, uint64_t seed) {
+	if (!pluginInstance) {
+		pluginInstance = new Plugin;
+		pluginInstance->slug = "BasicPlugin";
+	}
+	APP->engine->sampleRate = sampleRate;
+	random::seed(seed);
+}
+
+Model* findModel(const std::string& slug) {
+	for (Model* model : getModelRegistry()) {
+		if (model->slug == slug) return model;
+	}
+	return NULL;
+}
+
+int findParam(Module* module, const std::string& name) {
+	for (size_t i = 0; i < module->paramQuantities.size(); i++) {
+		if (module->paramQuantities[i] && module->paramQuantities[i]->name == name) return i;
+	}
+	return -1;
+}
+
+void dropFiles(ModuleWidget* widget, const std::vector<std::string>& paths) {
+	// Every pool worker is held until the last drop, so each drop lands
+	// while the loads started by the ones before it are still queued, as
+	// when a user drops in quick succession
+	SampleLoadPool& pool = SampleLoadPool::get();
+	std::promise<void> release;
+	std::shared_future<void> released = release.get_future().share();
+	for (unsigned int i = 0; i < SampleLoadPool::MAX_WORKERS; i++) {
+		pool.submit(&release, [released](const SampleLoadPool::Job& job) { released.wait(); }, INT_MAX);
+	}
+
+	for (const std::string& path : paths) {
+		event::PathDrop e;
+		e.paths = {path};
+		widget->onPathDrop(e);
+	}
+	release.set_value();
+	// Drops decode on the load pool
+	pool.waitIdle();
+}
+
+void stepWidget(ModuleWidget* widget) {
+	widget->step();
+	SampleLoadPool::get().waitIdle();
+}
+
+bool readWav(const std::string& path, std::vector<float>& samples, unsigned int& sampleRate) {
+	unsigned int channels;
+	drwav_uint64 frames;
+	float* data = drwav_open_file_and_read_pcm_frames_f32(path.c_str(), &channels, &sampleRate, &frames, NULL);
+	if (!data) return false;
+	samples.resize(frames);
+	for (drwav_uint64 i = 0; i < frames; i++) {
+		samples[i] = data[i * channels];
+	}
+	drwav_free(data, NULL);
+	return true;
+}
+
+bool writeWav(const std::string& path, const std::vector<float>& frames, int channels, unsigned int sampleRate) {
+	drwav_data_format format;
+	format.container = drwav_container_riff;
+	format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+	format.channels = channels;
+	format.sampleRate = sampleRate;
+	format.bitsPerSample = 32;
+
+	drwav wav;
+	if (!drwav_init_file_write(&wav, path.c_str(), &format, NULL)) return false;
+	drwav_write_pcm_frames(&wav, frames.size() / channels, frames.data());
+	drwav_uninit(&wav);
+	return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+// Helpers shared by the harness tools.
+#include "rack.hpp"
+
+extern Plugin* pluginInstance;
+
+// Sets up pluginInstance and the engine sample rate, and seeds the random
+// generator so runs are reproducible.
+void initHarness(float sampleRate, uint64_t seed);
+
+Model* findModel(const std::string& slug);
+
+// Finds a param by its configured name. Returns -1 if there is none.
+int findParam(Module* module, const std::string& name);
+
+// Drops files on the module's widget so it loads them the same way it does in
+// Rack, and waits for the loads that starts.
+void dropFiles(ModuleWidget* widget, const std::vector<std::string>& paths);
+
+// Runs one UI frame of the widget and waits for the loads it starts, so they
+// land at the same engine frame on every run.
+void stepWidget(ModuleWidget* widget);
+
+// Reads the first channel of a WAV file.
+bool readWav(const std::string& path, std::vector<float>& samples, unsigned int& sampleRate);
+
+// Writes interleaved float frames.
+bool writeWav(const std::string& path, const std::vector<float>& frames, int channels, unsigned int sampleRate);
@@ -0,0 +1,3 @@
+#pragma once
+// Provided by the harness rack.hpp stub.
+#include "../rack.hpp"
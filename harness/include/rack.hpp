@@ -0,0 +1,830 @@
+#pragma once
+// Minimal stand-in for the Rack SDK used by the headless harness.
+//
+// Only the engine side is functional: params, ports, lights, the dsp helpers
+// and random generator the modules use. Widgets, NanoVG and menus compile to
+// no-ops so the module sources build unchanged without a window or GL context.
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cstdarg>
+#include <atomic>
+#include <algorithm>
+#include <map>
+
+// --- JANSSON ---
+// Patch serialisation is not exercised headless; these only need to link.
+typedef struct json_t json_t;
+typedef struct { char text[160]; } json_error_t;
+typedef long long json_int_t;
+json_t* json_object();
+json_t* json_array();
+json_t* json_integer(json_int_t value);
+json_t* json_real(double value);
+json_t* json_string(const char* value);
+json_t* json_boolean(int value);
+int json_object_set_new(json_t* object, const char* key, json_t* value);
+json_t* json_object_get(const json_t* object, const char* key);
+json_int_t json_integer_value(const json_t* json);
+double json_real_value(const json_t* json);
+double json_number_value(const json_t* json);
+const char* json_string_value(const json_t* json);
+int json_is_true(const json_t* json);
+int json_boolean_value(const json_t* json);
+int json_array_append_new(json_t* array, json_t* value);
+size_t json_array_size(const json_t* array);
+json_t* json_array_get(const json_t* array, size_t index);
+int json_dumpf(const json_t* json, FILE* output, size_t flags);
+json_t* json_loadf(FILE* input, size_t flags, json_error_t* error);
+void json_decref(json_t* json);
+#define JSON_INDENT(n) (n)
+#define JSON_REAL_PRECISION(n) (n)
+
+// --- NANOVG ---
+struct NVGcolor { float r, g, b, a; };
+struct NVGcontext;
+inline NVGcolor nvgRGBAf(float r, float g, float b, float a) { return {r, g, b, a}; }
+inline NVGcolor nvgRGBf(float r, float g, float b) { return {r, g, b, 1.f}; }
+inline NVGcolor nvgRGBA(int r, int g, int b, int a) { return {r / 255.f, g / 255.f, b / 255.f, a / 255.f}; }
+inline NVGcolor nvgRGB(int r, int g, int b) { return nvgRGBA(r, g, b, 255); }
+inline void nvgBeginPath(NVGcontext*) {}
+inline void nvgRect(NVGcontext*, float, float, float, float) {}
+inline void nvgRoundedRect(NVGcontext*, float, float, float, float, float) {}
+inline void nvgCircle(NVGcontext*, float, float, float) {}
+inline void nvgFillColor(NVGcontext*, NVGcolor) {}
+inline void nvgFill(NVGcontext*) {}
+inline void nvgStrokeColor(NVGcontext*, NVGcolor) {}
+inline void nvgStrokeWidth(NVGcontext*, float) {}
+inline void nvgStroke(NVGcontext*) {}
+inline void nvgMoveTo(NVGcontext*, float, float) {}
+inline void nvgLineTo(NVGcontext*, float, float) {}
+inline void nvgScissor(NVGcontext*, float, float, float, float) {}
+inline void nvgResetScissor(NVGcontext*) {}
+inline void nvgFontSize(NVGcontext*, float) {}
+inline void nvgFontFaceId(NVGcontext*, int) {}
+inline void nvgTextAlign(NVGcontext*, int) {}
+inline float nvgText(NVGcontext*, float, float, const char*, const char*) { return 0.f; }
+enum { NVG_ALIGN_LEFT = 1, NVG_ALIGN_CENTER = 2, NVG_ALIGN_RIGHT = 4, NVG_ALIGN_TOP = 8, NVG_ALIGN_MIDDLE = 16, NVG_ALIGN_BOTTOM = 32 };
+
+#define GLFW_MOUSE_BUTTON_LEFT 0
+#define GLFW_MOUSE_BUTTON_RIGHT 1
+#define GLFW_PRESS 1
+#define GLFW_RELEASE 0
+
+struct NSVGpaint { char type; unsigned int color; };
+struct NSVGshape { char id[64]; NSVGpaint fill; NSVGpaint stroke; float opacity; NSVGshape* next; };
+struct NSVGimage { float width, height; NSVGshape* shapes; };
+
+#define DEBUG(format, ...) std::fprintf(stderr, "[debug] " format "\n", ##__VA_ARGS__)
+#define INFO(format, ...) std::fprintf(stderr, "[info] " format "\n", ##__VA_ARGS__)
+#define WARN(format, ...) std::fprintf(stderr, "[warn] " format "\n", ##__VA_ARGS__)
+
+namespace rack {
+
+struct Exception : std::exception {
+	std::string msg;
+	Exception(const std::string& msg = "") : msg(msg) {}
+	const char* what() const noexcept override { return msg.c_str(); }
+};
+
+namespace math {
+
+template <typename T>
+T clamp(T x, T a, T b) {
+	return std::max(std::min(x, b), a);
+}
+inline float rescale(float x, float xMin, float xMax, float yMin, float yMax) {
+	return yMin + (x - xMin) / (xMax - xMin) * (yMax - yMin);
+}
+inline float crossfade(float a, float b, float p) {
+	return a + (b - a) * p;
+}
+inline bool isNear(float a, float b, float epsilon = 1e-6f) {
+	return std::fabs(a - b) <= epsilon;
+}
+
+struct Vec {
+	float x = 0.f;
+	float y = 0.f;
+	Vec() {}
+	Vec(float x, float y) : x(x), y(y) {}
+	Vec plus(Vec b) const { return Vec(x + b.x, y + b.y); }
+	Vec minus(Vec b) const { return Vec(x - b.x, y - b.y); }
+	Vec mult(float s) const { return Vec(x * s, y * s); }
+	Vec operator+(Vec b) const { return plus(b); }
+	Vec operator-(Vec b) const { return minus(b); }
+};
+
+struct Rect {
+	Vec pos;
+	Vec size;
+};
+
+} // namespace math
+
+using namespace math;
+
+namespace random {
+// xoroshiro128+, seeded deterministically so renders are reproducible
+void seed(uint64_t s);
+uint64_t u64();
+inline uint32_t u32() { return (uint32_t)(u64() >> 32); }
+inline float uniform() { return (u64() >> 40) * 0x1.0p-24f; }
+float normal();
+} // namespace random
+
+namespace string {
+std::string f(const char* format, ...);
+std::string lowercase(const std::string& s);
+} // namespace string
+
+namespace system {
+std::string join(const std::string& path1, const std::string& path2);
+std::vector<std::string> getEntries(const std::string& dirPath, int depth = 0);
+bool exists(const std::string& path);
+bool isFile(const std::string& path);
+bool isDirectory(const std::string& path);
+uint64_t getFileSize(const std::string& path);
+bool createDirectory(const std::string& path);
+bool createDirectories(const std::string& path);
+bool remove(const std::string& path);
+std::string getDirectory(const std::string& path);
+std::string getFilename(const std::string& path);
+std::string getStem(const std::string& path);
+std::string getExtension(const std::string& path);
+double getTime();
+} // namespace system
+
+struct Plugin;
+
+namespace asset {
+std::string system(std::string filename);
+std::string user(std::string filename);
+std::string plugin(Plugin* plugin, std::string filename);
+} // namespace asset
+
+namespace dsp {
+
+static const float FREQ_C4 = 261.6256f;
+
+// 2^x with the integer part in the exponent bits and a degree 5 polynomial
+// for the fraction, as in Rack's dsp/approx.hpp
+inline float exp2_taylor5(float x) {
+	float xf = std::floor(x);
+	int32_t xi = (int32_t)xf;
+	xf = x - xf;
+	int32_t bits = (xi + 127) << 23;
+	float yi;
+	std::memcpy(&yi, &bits, sizeof(yi));
+	float yf = 1.f + xf * (0.693147180559945f + xf * (0.240226506959101f + xf * (0.0555041086648216f + xf * (0.00961812910762848f + xf * 0.00133335581464284f))));
+	return yi * yf;
+}
+
+// FIR helpers from Rack's dsp/common.hpp, dsp/fir.hpp and dsp/window.hpp
+inline float sinc(float x) {
+	if (x == 0.f) return 1.f;
+	x *= (float)M_PI;
+	return std::sin(x) / x;
+}
+
+inline void boxcarLowpassIR(float* out, int len, float cutoff = 0.5f) {
+	for (int i = 0; i < len; i++) {
+		float t = i - (len - 1) / 2.f;
+		out[i] = 2 * cutoff * sinc(2 * cutoff * t);
+	}
+}
+
+inline float blackmanHarris(float p) {
+	return 0.35875f - 0.48829f * std::cos(2 * (float)M_PI * p) + 0.14128f * std::cos(4 * (float)M_PI * p) - 0.01168f * std::cos(6 * (float)M_PI * p);
+}
+
+inline void blackmanHarrisWindow(float* x, int len) {
+	for (int i = 0; i < len; i++) {
+		x[i] *= blackmanHarris((float)i / (len - 1));
+	}
+}
+
+struct SchmittTrigger {
+	bool state = true;
+	void reset() { state = true; }
+	bool process(float in, float lowThreshold = 0.f, float highThreshold = 1.f) {
+		if (state) {
+			if (in <= lowThreshold) state = false;
+		}
+		else if (in >= highThreshold) {
+			state = true;
+			return true;
+		}
+		return false;
+	}
+	bool isHigh() { return state; }
+};
+
+struct BooleanTrigger {
+	bool state = true;
+	void reset() { state = true; }
+	bool process(bool s) {
+		bool triggered = s && !state;
+		state = s;
+		return triggered;
+	}
+};
+
+struct PulseGenerator {
+	float remaining = 0.f;
+	void reset() { remaining = 0.f; }
+	bool process(float deltaTime) {
+		if (remaining > 0.f) {
+			remaining -= deltaTime;
+			return true;
+		}
+		return false;
+	}
+	void trigger(float duration = 1e-3f) {
+		if (duration > remaining) remaining = duration;
+	}
+};
+
+struct ClockDivider {
+	uint32_t clock = 0;
+	uint32_t division = 1;
+	void reset() { clock = 0; }
+	void setDivision(uint32_t d) { division = d; }
+	uint32_t getDivision() { return division; }
+	uint32_t getClock() { return clock; }
+	bool process() {
+		clock++;
+		if (clock >= division) {
+			clock = 0;
+			return true;
+		}
+		return false;
+	}
+};
+
+template <typename T = float>
+struct TExponentialFilter {
+	T out = 0.f;
+	T lambda = 0.f;
+	void reset() { out = 0.f; }
+	void setLambda(T lambda) { this->lambda = lambda; }
+	void setTau(T tau) { this->lambda = 1 / tau; }
+	T process(T deltaTime, T in) {
+		T y = out + (in - out) * lambda * deltaTime;
+		out = (out == y) ? in : y;
+		return out;
+	}
+};
+typedef TExponentialFilter<> ExponentialFilter;
+
+template <typename T = float>
+struct TSlewLimiter {
+	T out = 0.f;
+	T rise = 0.f;
+	T fall = 0.f;
+	void reset() { out = 0.f; }
+	void setRiseFall(T rise, T fall) { this->rise = rise; this->fall = fall; }
+	T process(T deltaTime, T in) {
+		out = math::clamp(in, out - fall * deltaTime, out + rise * deltaTime);
+		return out;
+	}
+};
+typedef TSlewLimiter<> SlewLimiter;
+
+} // namespace dsp
+
+struct Model;
+
+struct Plugin {
+	std::string slug;
+	std::string path;
+	std::vector<Model*> models;
+	void addModel(Model* model) { models.push_back(model); }
+};
+
+namespace engine {
+
+struct Module;
+
+struct Param {
+	float value = 0.f;
+	float getValue() { return value; }
+	void setValue(float value) { this->value = value; }
+};
+
+static const int PORT_MAX_CHANNELS = 16;
+
+struct Port {
+	float voltages[PORT_MAX_CHANNELS] = {};
+	uint8_t channels = 0;
+	void setVoltage(float voltage, int channel = 0) { voltages[channel] = voltage; }
+	float getVoltage(int channel = 0) { return voltages[channel]; }
+	float getPolyVoltage(int channel) { return isMonophonic() ? getVoltage(0) : getVoltage(channel); }
+	float getNormalVoltage(float normalVoltage, int channel = 0) { return isConnected() ? getVoltage(channel) : normalVoltage; }
+	float getVoltageSum() {
+		float sum = 0.f;
+		for (int c = 0; c < channels; c++) sum += voltages[c];
+		return sum;
+	}
+	float* getVoltages(int firstChannel = 0) { return &voltages[firstChannel]; }
+	void setChannels(int channels) {
+		if (this->channels == 0) return;
+		for (int c = channels; c < this->channels; c++) voltages[c] = 0.f;
+		this->channels = std::max(channels, 1);
+	}
+	int getChannels() { return channels; }
+	bool isConnected() { return channels > 0; }
+	bool isMonophonic() { return channels == 1; }
+	bool isPolyphonic() { return channels > 1; }
+};
+
+struct Input : Port {};
+struct Output : Port {};
+
+struct Light {
+	float value = 0.f;
+	void setBrightness(float brightness) { value = brightness; }
+	float getBrightness() { return value; }
+	void setBrightnessSmooth(float brightness, float deltaTime, float lambda = 30.f) { value += (brightness - value) * lambda * deltaTime; }
+};
+
+struct ParamQuantity {
+	Module* module = nullptr;
+	int paramId = 0;
+	float minValue = 0.f;
+	float maxValue = 1.f;
+	float defaultValue = 0.f;
+	std::string name;
+	std::string unit;
+	bool snapEnabled = false;
+	bool randomizeEnabled = true;
+	virtual ~ParamQuantity() {}
+	virtual float getValue();
+	virtual void setValue(float value);
+	virtual std::string getDisplayValueString();
+	virtual std::string getLabel() { return name; }
+};
+
+struct SwitchQuantity : ParamQuantity {
+	std::vector<std::string> labels;
+};
+
+struct PortInfo {
+	std::string name;
+};
+
+struct Module {
+	struct ProcessArgs {
+		float sampleRate;
+		float sampleTime;
+		int64_t frame;
+	};
+	struct SampleRateChangeEvent {
+		float sampleRate;
+		float sampleTime;
+	};
+	struct ResetEvent {};
+	struct AddEvent {};
+	struct RemoveEvent {};
+	struct SaveEvent {};
+
+	int64_t id = 0;
+	Model* model = nullptr;
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+	std::vector<ParamQuantity*> paramQuantities;
+	std::vector<PortInfo*> inputInfos;
+	std::vector<PortInfo*> outputInfos;
+
+	virtual ~Module();
+
+	void config(int numParams, int numInputs, int numOutputs, int numLights = 0);
+
+	template <class TParamQuantity = ParamQuantity>
+	TParamQuantity* configParam(int paramId, float minValue, float maxValue, float defaultValue, std::string name = "", std::string unit = "", float displayBase = 0.f, float displayMultiplier = 1.f, float displayOffset = 0.f) {
+		delete paramQuantities[paramId];
+		TParamQuantity* q = new TParamQuantity;
+		q->module = this;
+		q->paramId = paramId;
+		q->minValue = minValue;
+		q->maxValue = maxValue;
+		q->defaultValue = defaultValue;
+		q->name = name;
+		q->unit = unit;
+		paramQuantities[paramId] = q;
+		params[paramId].value = defaultValue;
+		return q;
+	}
+
+	template <class TSwitchQuantity = SwitchQuantity>
+	TSwitchQuantity* configSwitch(int paramId, float minValue, float maxValue, float defaultValue, std::string name = "", std::vector<std::string> labels = {}) {
+		TSwitchQuantity* q = configParam<TSwitchQuantity>(paramId, minValue, maxValue, defaultValue, name);
+		q->snapEnabled = true;
+		q->labels = labels;
+		return q;
+	}
+
+	template <class TSwitchQuantity = SwitchQuantity>
+	TSwitchQuantity* configButton(int paramId, std::string name = "") {
+		return configSwitch<TSwitchQuantity>(paramId, 0.f, 1.f, 0.f, name, {});
+	}
+
+	PortInfo* configInput(int portId, std::string name = "");
+	PortInfo* configOutput(int portId, std::string name = "");
+	void configLight(int, std::string = "") {}
+	void configBypass(int, int) {}
+
+	virtual void process(const ProcessArgs& args) {}
+	virtual json_t* dataToJson() { return NULL; }
+	virtual void dataFromJson(json_t* rootJ) {}
+	virtual void onSampleRateChange(const SampleRateChangeEvent& e) {}
+	virtual void onReset(const ResetEvent& e) {}
+	virtual void onAdd(const AddEvent& e) {}
+	virtual void onRemove(const RemoveEvent& e) {}
+	virtual void onSave(const SaveEvent& e) {}
+
+	std::string getPatchStorageDirectory();
+	std::string createPatchStorageDirectory();
+	float getSampleRate();
+};
+
+struct Engine {
+	float sampleRate = 44100.f;
+	float getSampleRate() { return sampleRate; }
+	void addModule(Module*) {}
+};
+
+} // namespace engine
+
+using namespace engine;
+
+namespace window {
+struct Font {
+	int handle = -1;
+};
+struct Svg {
+	NSVGimage* handle = NULL;
+	void loadFile(const std::string&) {}
+};
+struct Window {
+	std::shared_ptr<Font> loadFont(const std::string&) { return std::make_shared<Font>(); }
+	std::shared_ptr<Svg> loadSvg(const std::string&) { return std::make_shared<Svg>(); }
+};
+} // namespace window
+
+using namespace window;
+
+namespace event {
+struct Base {
+	void consume(void*) const {}
+};
+struct Action : Base {};
+struct Button : Base {
+	Vec pos;
+	int button = 0;
+	int action = 0;
+	int mods = 0;
+};
+struct DragStart : Base {
+	int button = 0;
+};
+struct DragMove : Base {
+	int button = 0;
+	Vec mouseDelta;
+};
+struct PathDrop : Base {
+	std::vector<std::string> paths;
+};
+struct Hover : Base {
+	Vec pos;
+};
+} // namespace event
+
+namespace widget {
+
+struct Widget {
+	Rect box;
+	Widget* parent = NULL;
+	std::vector<Widget*> children;
+	bool visible = true;
+
+	struct DrawArgs {
+		NVGcontext* vg = NULL;
+		Rect clipBox;
+	};
+	typedef event::Button ButtonEvent;
+	typedef event::DragStart DragStartEvent;
+	typedef event::DragMove DragMoveEvent;
+	typedef event::PathDrop PathDropEvent;
+	typedef event::Hover HoverEvent;
+
+	virtual ~Widget() {
+		for (Widget* child : children) delete child;
+	}
+	void addChild(Widget* child) {
+		child->parent = this;
+		children.push_back(child);
+	}
+	void addChildBottom(Widget* child) {
+		child->parent = this;
+		children.insert(children.begin(), child);
+	}
+	void removeChild(Widget* child) {
+		children.erase(std::remove(children.begin(), children.end(), child), children.end());
+		child->parent = NULL;
+	}
+	void setVisible(bool visible) { this->visible = visible; }
+	bool isVisible() { return visible; }
+	void setSize(Vec size) { box.size = size; }
+	Vec getAbsoluteOffset(Vec v) { return v; }
+
+	virtual void step() {}
+	virtual void draw(const DrawArgs& args) {}
+	virtual void drawLayer(const DrawArgs& args, int layer) {}
+	virtual void onButton(const ButtonEvent& e) {}
+	virtual void onDragStart(const DragStartEvent& e) {}
+	virtual void onDragMove(const DragMoveEvent& e) {}
+	virtual void onPathDrop(const PathDropEvent& e) {}
+	virtual void onHover(const HoverEvent& e) {}
+};
+
+struct TransparentWidget : Widget {};
+struct OpaqueWidget : Widget {};
+struct FramebufferWidget : Widget {
+	void setDirty(bool dirty = true) {}
+};
+struct SvgWidget : Widget {
+	std::shared_ptr<Svg> svg;
+	void setSvg(std::shared_ptr<Svg> svg) { this->svg = svg; }
+};
+
+} // namespace widget
+
+using namespace widget;
+
+namespace ui {
+struct Menu : widget::OpaqueWidget {};
+struct MenuEntry : widget::OpaqueWidget {};
+struct MenuSeparator : MenuEntry {};
+struct MenuLabel : MenuEntry {
+	std::string text;
+};
+struct MenuItem : MenuEntry {
+	std::string text;
+	std::string rightText;
+	bool disabled = false;
+	virtual void onAction(const event::Action& e) {}
+	virtual Menu* createChildMenu() { return NULL; }
+};
+} // namespace ui
+
+using namespace ui;
+
+namespace app {
+
+struct SvgPanel : widget::Widget {
+	widget::SvgWidget* sw = new widget::SvgWidget;
+	SvgPanel() { addChild(sw); }
+	void setBackground(std::shared_ptr<Svg> svg) { sw->setSvg(svg); }
+};
+struct ParamWidget : widget::OpaqueWidget {
+	engine::Module* module = NULL;
+	int paramId = 0;
+};
+struct PortWidget : widget::OpaqueWidget {
+	engine::Module* module = NULL;
+	int portId = 0;
+};
+struct ModuleLightWidget : widget::Widget {};
+
+struct ModuleWidget : widget::OpaqueWidget {
+	Model* model = NULL;
+	engine::Module* module = NULL;
+	widget::Widget* panel = NULL;
+
+	void setModule(engine::Module* module) { this->module = module; }
+	engine::Module* getModule() { return module; }
+	void setPanel(widget::Widget* panel) {
+		this->panel = panel;
+		addChildBottom(panel);
+	}
+	void setPanel(std::shared_ptr<Svg> svg) {
+		SvgPanel* svgPanel = new SvgPanel;
+		svgPanel->setBackground(svg);
+		setPanel(svgPanel);
+	}
+	widget::Widget* getPanel() { return panel; }
+	void addParam(ParamWidget* param) { addChild(param); }
+	void addInput(PortWidget* input) { addChild(input); }
+	void addOutput(PortWidget* output) { addChild(output); }
+	virtual void appendContextMenu(ui::Menu* menu) {}
+	void step() override {}
+};
+
+struct RackWidget {
+	void setModulePosNearest(ModuleWidget*, Vec) {}
+	void addModule(ModuleWidget*) {}
+};
+
+struct Scene : widget::OpaqueWidget {
+	RackWidget* rack = NULL;
+	Vec mousePos;
+};
+
+} // namespace app
+
+using namespace app;
+
+namespace history {
+struct Action {
+	std::string name;
+	virtual ~Action() {}
+};
+struct ModuleAdd : Action {
+	void setModule(app::ModuleWidget*) {}
+};
+struct State {
+	void push(Action* action) { delete action; }
+};
+} // namespace history
+
+struct Context {
+	engine::Engine* engine = NULL;
+	app::Scene* scene = NULL;
+	window::Window* window = NULL;
+	history::State* history = NULL;
+};
+
+Context* contextGet();
+#define APP rack::contextGet()
+
+// --- MODEL REGISTRY ---
+// createModel() records every model so the harness can look modules up by slug.
+
+struct Model {
+	Plugin* plugin = NULL;
+	std::string slug;
+	virtual ~Model() {}
+	virtual engine::Module* createModule() = 0;
+	virtual app::ModuleWidget* createModuleWidget(engine::Module* m) = 0;
+};
+
+std::vector<Model*>& getModelRegistry();
+
+template <class TModule, class TModuleWidget>
+Model* createModel(std::string slug) {
+	struct TModel : Model {
+		engine::Module* createModule() override {
+			engine::Module* m = new TModule;
+			m->model = this;
+			return m;
+		}
+		app::ModuleWidget* createModuleWidget(engine::Module* m) override {
+			TModule* tm = dynamic_cast<TModule*>(m);
+			app::ModuleWidget* mw = new TModuleWidget(tm);
+			mw->model = this;
+			return mw;
+		}
+	};
+	TModel* model = new TModel;
+	model->slug = slug;
+	getModelRegistry().push_back(model);
+	return model;
+}
+
+// --- WIDGET HELPERS ---
+
+template <class TWidget>
+TWidget* createWidget(Vec pos) {
+	TWidget* w = new TWidget;
+	w->box.pos = pos;
+	return w;
+}
+template <class TWidget>
+TWidget* createWidgetCentered(Vec pos) {
+	return createWidget<TWidget>(pos);
+}
+inline app::SvgPanel* createPanel(std::string svgPath) {
+	app::SvgPanel* panel = new app::SvgPanel;
+	panel->setBackground(APP->window->loadSvg(svgPath));
+	return panel;
+}
+template <class TParamWidget>
+TParamWidget* createParam(Vec pos, engine::Module* module, int paramId) {
+	TParamWidget* o = createWidget<TParamWidget>(pos);
+	o->module = module;
+	o->paramId = paramId;
+	return o;
+}
+template <class TParamWidget>
+TParamWidget* createParamCentered(Vec pos, engine::Module* module, int paramId) {
+	return createParam<TParamWidget>(pos, module, paramId);
+}
+template <class TParamWidget>
+TParamWidget* createLightParamCentered(Vec pos, engine::Module* module, int paramId, int firstLightId) {
+	return createParam<TParamWidget>(pos, module, paramId);
+}
+template <class TPortWidget>
+TPortWidget* createInputCentered(Vec pos, engine::Module* module, int inputId) {
+	TPortWidget* o = createWidget<TPortWidget>(pos);
+	o->module = module;
+	o->portId = inputId;
+	return o;
+}
+template <class TPortWidget>
+TPortWidget* createOutputCentered(Vec pos, engine::Module* module, int outputId) {
+	return createInputCentered<TPortWidget>(pos, module, outputId);
+}
+template <class TModuleLightWidget>
+TModuleLightWidget* createLightCentered(Vec pos, engine::Module* module, int firstLightId) {
+	return createWidget<TModuleLightWidget>(pos);
+}
+inline Vec mm2px(Vec mm) {
+	return mm.mult(75.f / 25.4f);
+}
+
+template <class TMenuItem = ui::MenuItem>
+TMenuItem* createMenuItem(std::string text, std::string rightText = "", std::function<void()> action = NULL, bool disabled = false) {
+	TMenuItem* item = new TMenuItem;
+	item->text = text;
+	item->rightText = rightText;
+	return item;
+}
+template <class TMenuItem = ui::MenuItem>
+TMenuItem* createCheckMenuItem(std::string text, std::string rightText, std::function<bool()> checked, std::function<void()> action, bool disabled = false) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+template <class TMenuItem = ui::MenuItem>
+TMenuItem* createBoolPtrMenuItem(std::string text, std::string rightText, bool* ptr) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+template <class TMenuItem = ui::MenuItem>
+TMenuItem* createSubmenuItem(std::string text, std::string rightText, std::function<void(ui::Menu*)> createMenu, bool disabled = false) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+template <class TMenuItem = ui::MenuItem>
+TMenuItem* createIndexSubmenuItem(std::string text, std::vector<std::string> labels, std::function<size_t()> getter, std::function<void(size_t)> setter, bool disabled = false, bool alwaysConsume = false) {
+	return createMenuItem<TMenuItem>(text);
+}
+template <class TMenuItem = ui::MenuItem, typename T>
+TMenuItem* createIndexPtrSubmenuItem(std::string text, std::vector<std::string> labels, T* ptr) {
+	return createMenuItem<TMenuItem>(text);
+}
+inline ui::MenuLabel* createMenuLabel(std::string text) {
+	ui::MenuLabel* label = new ui::MenuLabel;
+	label->text = text;
+	return label;
+}
+
+template <class T, typename F, typename V, typename... Args>
+void constructSet(T* o, F f, V v, Args... args) {
+	o->*f = v;
+	if constexpr (sizeof...(args) > 0) constructSet(o, args...);
+}
+template <class T, typename... Args>
+T* construct(Args... args) {
+	T* o = new T;
+	if constexpr (sizeof...(args) > 0) constructSet(o, args...);
+	return o;
+}
+
+// --- COMPONENT LIBRARY ---
+
+static const float RACK_GRID_WIDTH = 15.f;
+static const float RACK_GRID_HEIGHT = 380.f;
+
+struct ScrewSilver : widget::Widget {};
+struct RoundBlackKnob : app::ParamWidget {};
+struct RoundSmallBlackKnob : app::ParamWidget {};
+struct Trimpot : app::ParamWidget {};
+struct CKSS : app::ParamWidget {};
+struct CKSSThree : app::ParamWidget {};
+struct TL1105 : app::ParamWidget {};
+struct VCVButton : app::ParamWidget {};
+struct PJ301MPort : app::PortWidget {};
+template <typename TBase>
+struct MediumLight : app::ModuleLightWidget {};
+template <typename TBase>
+struct SmallLight : app::ModuleLightWidget {};
+template <typename TBase>
+struct MediumSimpleLight : app::ModuleLightWidget {};
+template <typename TBase>
+struct VCVLightLatch : app::ParamWidget {};
+template <typename TBase>
+struct VCVLightBezel : app::ParamWidget {};
+struct RedLight {};
+struct GreenLight {};
+struct BlueLight {};
+struct WhiteLight {};
+struct YellowLight {};
+
+} // namespace rack
+
+using namespace rack;
@@ -0,0 +1,295 @@
+// Definitions behind the harness rack.hpp stub.
+#include "rack.hpp"
+#include <chrono>
+#include <sys/stat.h>
+#include <dirent.h>
+
+// --- JANSSON ---
+
+json_t* json_object() { return NULL; }
+json_t* json_array() { return NULL; }
+json_t* json_integer(json_int_t) { return NULL; }
+json_t* json_real(double) { return NULL; }
+json_t* json_string(const char*) { return NULL; }
+json_t* json_boolean(int) { return NULL; }
+int json_object_set_new(json_t*, const char*, json_t*) { return -1; }
+json_t* json_object_get(const json_t*, const char*) { return NULL; }
+json_int_t json_integer_value(const json_t*) { return 0; }
+double json_real_value(const json_t*) { return 0.0; }
+double json_number_value(const json_t*) { return 0.0; }
+const char* json_string_value(const json_t*) { return NULL; }
+int json_is_true(const json_t*) { return 0; }
+int json_boolean_value(const json_t*) { return 0; }
+int json_array_append_new(json_t*, json_t*) { return -1; }
+size_t json_array_size(const json_t*) { return 0; }
+json_t* json_array_get(const json_t*, size_t) { return NULL; }
+int json_dumpf(const json_t*, FILE*, size_t) { return -1; }
+json_t* json_loadf(FILE*, size_t, json_error_t*) { return NULL; }
+void json_decref(json_t*) {}
+
+namespace rack {
+
+// --- RANDOM ---
+
+namespace random {
+
+static uint64_t state[2] = {0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL};
+
+static uint64_t splitmix(uint64_t& x) {
+	uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void seed(uint64_t s) {
+	state[0] = splitmix(s);
+	state[1] = splitmix(s);
+}
+
+uint64_t u64() {
+	uint64_t s0 = state[0];
+	uint64_t s1 = state[1];
+	uint64_t result = s0 + s1;
+	s1 ^= s0;
+	state[0] = ((s0 << 55) | (s0 >> 9)) ^ s1 ^ (s1 << 14);
+	state[1] = (s1 << 36) | (s1 >> 28);
+	return result;
+}
+
+float normal() {
+	// Box-Muller
+	float u1 = std::max(uniform(), 1e-12f);
+	float u2 = uniform();
+	return std::sqrt(-2.f * std::log(u1)) * std::cos(2.f * (float)M_PI * u2);
+}
+
+} // namespace random
+
+// --- STRING ---
+
+namespace string {
+
+std::string f(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	int size = std::vsnprintf(NULL, 0, format, argsCopy);
+	va_end(argsCopy);
+	std::string s(size > 0 ? size : 0, '\0');
+	if (size > 0) std::vsnprintf(&s[0], size + 1, format, args);
+	va_end(args);
+	return s;
+}
+
+std::string lowercase(const std::string& s) {
+	std::string r = s;
+	std::transform(r.begin(), r.end(), r.begin(), [](unsigned char c) { return std::tolower(c); });
+	return r;
+}
+
+} // namespace string
+
+// --- SYSTEM ---
+
+namespace system {
+
+std::string join(const std::string& path1, const std::string& path2) {
+	if (path1.empty()) return path2;
+	return path1 + "/" + path2;
+}
+
+std::vector<std::string> getEntries(const std::string& dirPath, int depth) {
+	std::vector<std::string> entries;
+	DIR* dir = opendir(dirPath.c_str());
+	if (!dir) return entries;
+	while (struct dirent* ent = readdir(dir)) {
+		std::string name = ent->d_name;
+		if (name == "." || name == "..") continue;
+		std::string path = join(dirPath, name);
+		entries.push_back(path);
+		if (depth != 0 && isDirectory(path)) {
+			std::vector<std::string> sub = getEntries(path, depth - 1);
+			entries.insert(entries.end(), sub.begin(), sub.end());
+		}
+	}
+	closedir(dir);
+	return entries;
+}
+
+bool exists(const std::string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
+
+bool isFile(const std::string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+bool isDirectory(const std::string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+uint64_t getFileSize(const std::string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+bool createDirectory(const std::string& path) {
+	return mkdir(path.c_str(), 0755) == 0;
+}
+
+bool createDirectories(const std::string& path) {
+	for (size_t i = 1; i <= path.size(); i++) {
+		if (i == path.size() || path[i] == '/') {
+			std::string sub = path.substr(0, i);
+			if (!isDirectory(sub) && mkdir(sub.c_str(), 0755) != 0) return false;
+		}
+	}
+	return true;
+}
+
+bool remove(const std::string& path) {
+	return std::remove(path.c_str()) == 0;
+}
+
+std::string getDirectory(const std::string& path) {
+	size_t pos = path.find_last_of('/');
+	return pos == std::string::npos ? "." : path.substr(0, pos);
+}
+
+std::string getFilename(const std::string& path) {
+	size_t pos = path.find_last_of('/');
+	return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+std::string getStem(const std::string& path) {
+	std::string filename = getFilename(path);
+	size_t pos = filename.find_last_of('.');
+	return pos == std::string::npos ? filename : filename.substr(0, pos);
+}
+
+std::string getExtension(const std::string& path) {
+	std::string filename = getFilename(path);
+	size_t pos = filename.find_last_of('.');
+	return pos == std::string::npos ? "" : filename.substr(pos);
+}
+
+double getTime() {
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace system
+
+// --- ASSET ---
+
+namespace asset {
+
+// The Makefile anchors the default under harness/, so files written by the
+// modules never land in whatever directory the tools are run from
+#ifndef HARNESS_USER_DIR
+#define HARNESS_USER_DIR "harness_user"
+#endif
+
+static std::string userDir() {
+	const char* dir = std::getenv("HARNESS_USER_DIR");
+	return dir ? dir : HARNESS_USER_DIR;
+}
+
+std::string system(std::string filename) {
+	return filename;
+}
+
+std::string user(std::string filename) {
+	return system::join(userDir(), filename);
+}
+
+std::string plugin(Plugin* plugin, std::string filename) {
+	return filename;
+}
+
+} // namespace asset
+
+// --- ENGINE ---
+
+namespace engine {
+
+float ParamQuantity::getValue() {
+	return module ? module->params[paramId].getValue() : 0.f;
+}
+
+void ParamQuantity::setValue(float value) {
+	if (module) module->params[paramId].setValue(math::clamp(value, minValue, maxValue));
+}
+
+std::string ParamQuantity::getDisplayValueString() {
+	return string::f("%g", getValue());
+}
+
+Module::~Module() {
+	for (ParamQuantity* q : paramQuantities) delete q;
+	for (PortInfo* info : inputInfos) delete info;
+	for (PortInfo* info : outputInfos) delete info;
+}
+
+void Module::config(int numParams, int numInputs, int numOutputs, int numLights) {
+	params.resize(numParams);
+	inputs.resize(numInputs);
+	outputs.resize(numOutputs);
+	lights.resize(numLights);
+	paramQuantities.resize(numParams, NULL);
+	inputInfos.resize(numInputs, NULL);
+	outputInfos.resize(numOutputs, NULL);
+	// Outputs are always "connected" headless so every one is rendered
+	for (Output& output : outputs) output.channels = 1;
+}
+
+PortInfo* Module::configInput(int portId, std::string name) {
+	delete inputInfos[portId];
+	inputInfos[portId] = new PortInfo{name};
+	return inputInfos[portId];
+}
+
+PortInfo* Module::configOutput(int portId, std::string name) {
+	delete outputInfos[portId];
+	outputInfos[portId] = new PortInfo{name};
+	return outputInfos[portId];
+}
+
+std::string Module::getPatchStorageDirectory() {
+	return asset::user(string::f("patch/%lld", (long long)id));
+}
+
+std::string Module::createPatchStorageDirectory() {
+	std::string dir = getPatchStorageDirectory();
+	system::createDirectories(dir);
+	return dir;
+}
+
+float Module::getSampleRate() {
+	return APP->engine->getSampleRate();
+}
+
+} // namespace engine
+
+// --- CONTEXT ---
+
+Context* contextGet() {
+	static engine::Engine engine;
+	static app::Scene scene;
+	static window::Window window;
+	static history::State history;
+	static Context context = {&engine, &scene, &window, &history};
+	return &context;
+}
+
+std::vector<Model*>& getModelRegistry() {
+	static std::vector<Model*> models;
+	return models;
+}
+
+} // namespace rack
@@ -0,0 +1,252 @@
+// Headless offline renderer.
+//
+// Runs one of the plugin's modules against the stub engine, applying a
+// parameter/CV script and optional WAV inputs, and writes every output port
+// to a float WAV file. Renders as fast as the CPU allows.
+//
+//   render --module granular --drop loop.wav --script sweep.txt --seconds 30 --out out.wav
+//
+// The module widget steps at 60 Hz of engine time, and each step waits for
+// the loads it starts, so background loads such as a dropped folder's
+// prefetch land at the same frame on every run.
+//
+// With --expect-signal the render fails if every output stayed silent, so
+// the Makefile's check target can catch a module stuck in a load.
+//
+// Script lines are "<seconds> param|input <index> <value> [channel]". Input
+// events connect the port and hold the voltage until the next event; '#'
+// starts a comment.
+#include "harness.hpp"
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+struct ScriptEvent {
+	double time;
+	bool isParam;
+	int index;
+	float value;
+	int channel;
+};
+
+struct WavInput {
+	int index;
+	std::vector<float> samples;
+};
+
+static void printUsage() {
+	std::fprintf(stderr,
+		"usage: render --module <slug> --out <file.wav> [options]\n"
+		"  --seconds <s>         length to render (default 10)\n"
+		"  --rate <hz>           engine sample rate (default 48000)\n"
+		"  --seed <n>            random seed (default 1)\n"
+		"  --script <file>       parameter / CV events\n"
+		"  --drop <file>         drop a file on the module widget before rendering\n"
+		"  --input <id>=<file>   feed a WAV into an input at +-5V, first channel only\n"
+		"  --expect-signal       exit with an error if every output stays silent\n"
+		"  --list                list the available modules and their ports\n");
+}
+
+static bool readScript(const std::string& path, std::vector<ScriptEvent>& events) {
+	std::ifstream file(path);
+	if (!file) {
+		std::fprintf(stderr, "cannot open script %s\n", path.c_str());
+		return false;
+	}
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) line.resize(comment);
+
+		std::istringstream ss(line);
+		ScriptEvent ev;
+		std::string kind;
+		if (!(ss >> ev.time)) continue;
+		if (!(ss >> kind >> ev.index >> ev.value) || (kind != "param" && kind != "input")) {
+			std::fprintf(stderr, "%s:%d: expected '<seconds> param|input <index> <value> [channel]'\n", path.c_str(), lineNumber);
+			return false;
+		}
+		ev.isParam = kind == "param";
+		ev.channel = 0;
+		ss >> ev.channel;
+		events.push_back(ev);
+	}
+	std::stable_sort(events.begin(), events.end(), [](const ScriptEvent& a, const ScriptEvent& b) {
+		return a.time < b.time;
+	});
+	return true;
+}
+
+static bool readWavInput(const std::string& spec, float sampleRate, WavInput& input) {
+	size_t eq = spec.find('=');
+	if (eq == std::string::npos) {
+		std::fprintf(stderr, "--input expects <id>=<file>\n");
+		return false;
+	}
+	input.index = std::atoi(spec.substr(0, eq).c_str());
+	std::string path = spec.substr(eq + 1);
+
+	unsigned int fileRate;
+	if (!readWav(path, input.samples, fileRate)) {
+		std::fprintf(stderr, "cannot decode %s\n", path.c_str());
+		return false;
+	}
+	if (fileRate != (unsigned int)sampleRate) {
+		std::fprintf(stderr, "warning: %s is %u Hz, engine runs at %g Hz (no resampling)\n", path.c_str(), fileRate, sampleRate);
+	}
+	for (float& s : input.samples) {
+		s *= 5.f;
+	}
+	return true;
+}
+
+static void listModels() {
+	for (Model* model : getModelRegistry()) {
+		Module* module = model->createModule();
+		std::printf("%s\n", model->slug.c_str());
+		for (size_t i = 0; i < module->paramQuantities.size(); i++) {
+			ParamQuantity* q = module->paramQuantities[i];
+			if (q) std::printf("  param  %2zu  %s [%g, %g] default %g\n", i, q->name.c_str(), q->minValue, q->maxValue, q->defaultValue);
+		}
+		for (size_t i = 0; i < module->inputInfos.size(); i++) {
+			std::printf("  input  %2zu  %s\n", i, module->inputInfos[i] ? module->inputInfos[i]->name.c_str() : "");
+		}
+		for (size_t i = 0; i < module->outputInfos.size(); i++) {
+			std::printf("  output %2zu  %s\n", i, module->outputInfos[i] ? module->outputInfos[i]->name.c_str() : "");
+		}
+		delete module;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::string slug;
+	std::string outPath;
+	std::string scriptPath;
+	std::vector<std::string> drops;
+	std::vector<std::string> inputSpecs;
+	double seconds = 10.0;
+	float sampleRate = 48000.f;
+	uint64_t seed = 1;
+	bool expectSignal = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--list") {
+			initHarness(sampleRate, seed);
+			listModels();
+			return 0;
+		}
+		else if (arg == "--module" && hasValue) slug = argv[++i];
+		else if (arg == "--out" && hasValue) outPath = argv[++i];
+		else if (arg == "--script" && hasValue) scriptPath = argv[++i];
+		else if (arg == "--drop" && hasValue) drops.push_back(argv[++i]);
+		else if (arg == "--input" && hasValue) inputSpecs.push_back(argv[++i]);
+		else if (arg == "--seconds" && hasValue) seconds = std::atof(argv[++i]);
+		else if (arg == "--rate" && hasValue) sampleRate = std::atof(argv[++i]);
+		else if (arg == "--seed" && hasValue) seed = std::strtoull(argv[++i], NULL, 10);
+		else if (arg == "--expect-signal") expectSignal = true;
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+	if (slug.empty() || outPath.empty() || seconds <= 0.0 || sampleRate <= 0.f) {
+		printUsage();
+		return 1;
+	}
+
+	Model* model = findModel(slug);
+	if (!model) {
+		std::fprintf(stderr, "unknown module '%s', try --list\n", slug.c_str());
+		return 1;
+	}
+
+	std::vector<ScriptEvent> events;
+	if (!scriptPath.empty() && !readScript(scriptPath, events)) return 1;
+
+	std::vector<WavInput> wavInputs(inputSpecs.size());
+	for (size_t i = 0; i < inputSpecs.size(); i++) {
+		if (!readWavInput(inputSpecs[i], sampleRate, wavInputs[i])) return 1;
+	}
+
+	initHarness(sampleRate, seed);
+
+	Module* module = model->createModule();
+	module->onSampleRateChange({sampleRate, 1.f / sampleRate});
+	module->onAdd({});
+
+	for (const WavInput& input : wavInputs) {
+		if (input.index < 0 || input.index >= (int)module->inputs.size()) {
+			std::fprintf(stderr, "input %d out of range\n", input.index);
+			return 1;
+		}
+		module->inputs[input.index].channels = 1;
+	}
+
+	ModuleWidget* widget = model->createModuleWidget(module);
+	dropFiles(widget, drops);
+	int64_t uiInterval = std::max<int64_t>(1, (int64_t)(sampleRate / 60.f));
+
+	int64_t frames = (int64_t)(seconds * sampleRate);
+	int numOutputs = module->outputs.size();
+	std::vector<float> out((size_t)frames * std::max(numOutputs, 1), 0.f);
+
+	Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f / sampleRate;
+
+	size_t nextEvent = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (int64_t frame = 0; frame < frames; frame++) {
+		double time = frame * (double)args.sampleTime;
+		while (nextEvent < events.size() && events[nextEvent].time <= time) {
+			const ScriptEvent& ev = events[nextEvent++];
+			if (ev.isParam) {
+				if (ev.index >= 0 && ev.index < (int)module->params.size()) module->params[ev.index].setValue(ev.value);
+			}
+			else if (ev.index >= 0 && ev.index < (int)module->inputs.size() && ev.channel >= 0 && ev.channel < engine::PORT_MAX_CHANNELS) {
+				Input& input = module->inputs[ev.index];
+				input.channels = std::max<int>(input.channels, ev.channel + 1);
+				input.setVoltage(ev.value, ev.channel);
+			}
+		}
+		for (const WavInput& input : wavInputs) {
+			module->inputs[input.index].setVoltage(frame < (int64_t)input.samples.size() ? input.samples[frame] : 0.f);
+		}
+
+		if (frame > 0 && frame % uiInterval == 0) stepWidget(widget);
+
+		args.frame = frame;
+		module->process(args);
+
+		for (int o = 0; o < numOutputs; o++) {
+			out[(size_t)frame * numOutputs + o] = module->outputs[o].getVoltage() / 5.f;
+		}
+	}
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::fprintf(stderr, "%s: rendered %.2f s in %.3f s (%.1fx real time)\n", slug.c_str(), seconds, elapsed, elapsed > 0.0 ? seconds / elapsed : 0.0);
+
+	if (!writeWav(outPath, out, std::max(numOutputs, 1), (unsigned int)sampleRate)) {
+		std::fprintf(stderr, "cannot write %s\n", outPath.c_str());
+		return 1;
+	}
+
+	delete widget;
+	module->onRemove({});
+	delete module;
+
+	if (expectSignal) {
+		float peak = 0.f;
+		for (float v : out) peak = std::max(peak, std::fabs(v));
+		if (peak == 0.f) {
+			std::fprintf(stderr, "%s: every output stayed silent\n", slug.c_str());
+			return 1;
+		}
+	}
+	return 0;
+}
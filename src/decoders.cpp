@@ -0,0 +1,8 @@
+// The single translation unit that compiles the header-only decoders.
+// Everything else includes the headers for declarations only.
+#define DR_WAV_IMPLEMENTATION
+#include "dr_wav.h"
+#define DR_FLAC_IMPLEMENTATION
+#include "dr_flac.h"
+#define MINIMP3_IMPLEMENTATION
+#include "minimp3_ex.h"
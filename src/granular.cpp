@@ -1,12 +1,15 @@
 #include "plugin.hpp"
+#include "sample.hpp"
 #include <vector>
 #include <string>
 #include <atomic>
+#include <memory>
 #include <cmath>
 #include <algorithm> // For std::max, std::min
+#include <chrono>
+#include <mutex>
 
 #include "dsp/window.hpp"
-#include "dr_wav.h"
 
 // --- SHARED CONSTANTS FOR SYNC DIVISIONS ---
 // 1/32, 1/16, 1/8, 1/4, 1/2, 1 Bar, 2 Bars, 4 Bars
@@ -14,7 +17,89 @@ const float SYNC_DIVISIONS[] = { 0.03125f, 0.0625f, 0.125f, 0.25f, 0.5f, 1.0f, 2
 const char* SYNC_LABELS[] = { "1/32", "1/16", "1/8", "1/4", "1/2", "1 Bar", "2 Bars", "4 Bars" };
 const int NUM_SYNC_DIVS = 8;
 
+// --- OPTIONAL DSP PROFILING ---
+// Build with GRANULAR_PROFILE defined (make GRANULAR_PROFILE=1) to time the
+// stages of Granular::process and show the numbers in the context menu.
+// Without it the macros below expand to nothing.
+#ifdef GRANULAR_PROFILE
+struct GranularProfiler {
+    enum Stage { STAGE_SPAWN, STAGE_RENDER, STAGE_SATURATE, STAGE_RECORD, NUM_STAGES };
+    static const int BLOCK_SIZE = 256;
+
+    // Engine thread accumulators
+    int64_t stageNs[NUM_STAGES] = {};
+    int64_t blockNs = 0;
+    int64_t peakBlockNs = 0;
+    int64_t totalBlockNs = 0;
+    int blockSamples = 0;
+    int blocks = 0;
+    int spawns = 0;
+    int samplesSincePublish = 0;
+    uint64_t dropCount = 0;
+
+    // Published about twice a second for the UI
+    std::atomic<int> liveGrains{0};
+    std::atomic<float> spawnRate{0.f};
+    std::atomic<uint64_t> drops{0};
+    std::atomic<float> avgBlockUs{0.f};
+    std::atomic<float> peakBlockUs{0.f};
+    std::atomic<float> stageShare[NUM_STAGES] = {};
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void add(Stage stage, int64_t ns) {
+        stageNs[stage] += ns;
+        blockNs += ns;
+    }
+
+    // Called once per sample, closes blocks and publishes counters.
+    void tick(float sampleRate, size_t grainCount) {
+        if (++blockSamples >= BLOCK_SIZE) {
+            peakBlockNs = std::max(peakBlockNs, blockNs);
+            totalBlockNs += blockNs;
+            blocks++;
+            blockNs = 0;
+            blockSamples = 0;
+        }
+        if (++samplesSincePublish < sampleRate * 0.5f || blocks == 0) return;
+
+        int64_t stageTotal = 0;
+        for (int i = 0; i < NUM_STAGES; i++) stageTotal += stageNs[i];
+        for (int i = 0; i < NUM_STAGES; i++) {
+            stageShare[i] = stageTotal > 0 ? (float)stageNs[i] / stageTotal : 0.f;
+            stageNs[i] = 0;
+        }
+        liveGrains = (int)grainCount;
+        spawnRate = spawns * sampleRate / samplesSincePublish;
+        drops = dropCount;
+        avgBlockUs = totalBlockNs * 1e-3f / blocks;
+        peakBlockUs = peakBlockNs * 1e-3f;
+
+        spawns = 0;
+        samplesSincePublish = 0;
+        totalBlockNs = 0;
+        peakBlockNs = 0;
+        blocks = 0;
+    }
+};
+
+#define PROFILE_BEGIN(stage) int64_t profileStart_##stage = GranularProfiler::now()
+#define PROFILE_END(stage) profiler.add(GranularProfiler::stage, GranularProfiler::now() - profileStart_##stage)
+#define PROFILE_TICK(sampleRate) profiler.tick(sampleRate, grains.size())
+#define PROFILE_SPAWN() profiler.spawns++
+#define PROFILE_DROP() profiler.dropCount++
+#else
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#define PROFILE_TICK(sampleRate)
+#define PROFILE_SPAWN()
+#define PROFILE_DROP()
+#endif
+
 struct Granular;
+struct GranularSample;
 
 struct WaveformDisplay : rack::TransparentWidget {
     Granular* module = nullptr;
@@ -24,6 +109,8 @@ struct WaveformDisplay : rack::TransparentWidget {
     std::vector<NVGcolor> displayColorCache; // Store colors per pixel column
     float cacheBoxWidth = 0.f;
     size_t cacheBufferSize = 0;
+    // The sample the cache was built from
+    std::shared_ptr<GranularSample> cacheSample;
 
     // Track previous recording state to trigger zoom-snap on stop
     bool wasRecording = false;
@@ -77,7 +164,7 @@ struct WaveformDisplay : rack::TransparentWidget {
         }
     }
 
-    void regenerateCache();
+    void regenerateCache(const GranularSample& source, bool isRecording);
     void draw(const DrawArgs& args) override;
     void setParamFromMouse(Vec pos, DragHandle handle);
     void onButton(const ButtonEvent& e) override;
@@ -86,32 +173,82 @@ struct WaveformDisplay : rack::TransparentWidget {
 };
 
 struct Grain {
-    double bufferPos;
+    double bufferPos = 0.0;
     float life;
     float lifeIncrement;
     double playbackSpeedRatio;
     float finalEnvShape;
 
-    float getSample(const std::vector<float>& buffer, size_t activeLen) {
-        if (buffer.empty() || activeLen == 0) return 0.f;
-
-        size_t effectiveSize = activeLen;
-
-        int index1 = (int)bufferPos;
-        int index2 = (index1 + 1) % effectiveSize;
-        float frac = bufferPos - index1;
-
-        if (index1 < 0) index1 = 0;
-        if (index1 >= (int)effectiveSize) index1 = effectiveSize - 1;
-        if (index2 < 0) index2 = 0;
-        if (index2 >= (int)effectiveSize) index2 = effectiveSize - 1;
+    // Set when the scheduler steals this grain, which then fades out instead
+    // of being cut mid-cycle.
+    float fadeGain = 1.f;
+    float fadeStep = 0.f;
+    uint32_t birth = 0;
+    // Channel of the polyphonic mod inputs this grain follows
+    int modChannel = 0;
+
+    // Spawn-time random deviations, kept so tracked parameters can be
+    // recomputed around the current knob values
+    float pitchRandomRatio = 1.f;
+    float shapeDeviation = 0.f;
+    float sizeDeviation = 0.f;
+
+    // Loop bounds in samples, latched at spawn or refreshed at control rate
+    double loopStart = 0.0;
+    double loopEnd = 0.0;
+    double loopWidth = 0.0;
+    // Whole-sample bounds for the second interpolation tap
+    size_t headIndex = 0;
+    size_t endIndex = 0;
+
+    // The position is kept as a phase through one period of the loop:
+    // the loop width, or twice it for ping-pong, where the second half
+    // reads the loop backwards. bufferPos is derived from it, so advance
+    // wraps and turns round with arithmetic instead of branches.
+    double phase = 0.0;
+    double period = 0.0;
+    double invPeriod = 0.0;
+
+    // +1 forward, -1 reverse. Ping-pong grains turn round at the loop bounds.
+    float direction = 1.f;
+    bool pingPong = false;
+
+    // Pitch-synchronous grain from the formant-preserving mode, which keeps
+    // its own speed, size and shape
+    bool formant = false;
+
+    // advance keeps the position inside the loop, so only the second tap
+    // can cross the loop end; there it reads the loop head. That is a
+    // select rather than guard samples past the loop end: the sample is
+    // shared and never written for this, and grains with latched loops
+    // each have their own end.
+    // T is the sample storage type; see sampleToFloat.
+    template <typename T>
+    float getSample(const T* buffer) const {
+        size_t index = (size_t)bufferPos;
+        float frac = (float)(bufferPos - index);
+        size_t next = index + 1 < endIndex ? index + 1 : headIndex;
+        float a = sampleToFloat(buffer[index]);
+        float b = sampleToFloat(buffer[next]);
+        return a + (b - a) * frac;
+    }
 
-        float s1 = buffer[index1];
-        float s2 = buffer[index2];
-        return (1.f - frac) * s1 + frac * s2;
+    // Audio-rate position modulation moves the read head, not the grain
+    template <typename T>
+    float getSample(const T* buffer, size_t activeLen, double posOffset) const {
+        double pos = bufferPos + posOffset;
+        if (pos < 0.0) pos += activeLen;
+        else if (pos >= activeLen) pos -= activeLen;
+        pos = rack::math::clamp(pos, 0.0, (double)(activeLen - 1));
+
+        int index = (int)pos;
+        float frac = (float)(pos - index);
+        float a = sampleToFloat(buffer[index]);
+        float b = sampleToFloat(buffer[index + 1]);
+        return a + (b - a) * frac;
     }
 
-    float getEnvelope(float envShape) {
+    float getEnvelope(float envShape) const {
         float shape_square = 1.f;
         float shape_triangle = 1.f - (std::abs(life - 0.5f) * 2.f);
         float shape_sine = 0.5f * (1.f - std::cos(2.f * M_PI * life));
@@ -125,26 +262,843 @@ struct Grain {
         }
     }
 
-    void advance(double loopStart, double loopEnd) {
-        bufferPos += playbackSpeedRatio;
-        if (bufferPos >= loopEnd) {
-            double overflow = bufferPos - loopEnd;
-            double loopWidth = loopEnd - loopStart;
-            if (loopWidth > 0.00001) {
-                 bufferPos = loopStart + std::fmod(overflow, loopWidth);
-            } else {
-                 bufferPos = loopStart;
+    void advance(float speedScale = 1.f) {
+        phase += playbackSpeedRatio * direction * speedScale;
+        wrapPhase();
+        life += lifeIncrement;
+        fadeGain -= fadeStep;
+    }
+
+    // One floor brings any step, forward or back and however much wider
+    // than the loop, into [0, period). Ping-pong folds the second half of
+    // the period back over the loop.
+    void wrapPhase() {
+        phase -= period * std::floor(phase * invPeriod);
+        bufferPos = loopStart + std::max(loopWidth - std::abs(loopWidth - phase), 0.0);
+    }
+
+    // Set pingPong before the loop, and the loop before the position.
+    // Moving the bounds under a live grain keeps its position and, for
+    // ping-pong, the way it is heading.
+    void setLoop(double start, double end) {
+        bool returning = pingPong && phase > loopWidth;
+        loopStart = start;
+        loopEnd = end;
+        loopWidth = end - start;
+        headIndex = (size_t)start;
+        endIndex = (size_t)end;
+        period = pingPong ? 2.0 * loopWidth : loopWidth;
+        invPeriod = 1.0 / period;
+        double offset = bufferPos - start;
+        phase = returning ? period - offset : offset;
+        wrapPhase();
+    }
+
+    void setPosition(double pos) {
+        phase = pos - loopStart;
+        wrapPhase();
+    }
+
+    void release(float fadeSamples) {
+        fadeStep = 1.f / std::max(fadeSamples, 1.f);
+    }
+
+    bool isReleasing() const { return fadeStep > 0.f; }
+    bool isAlive() { return life < 1.f && fadeGain > 0.f; }
+};
+
+// --- SAMPLE HANDOFF ---
+// Sample storage shared between the engine and the UI. It is sized before
+// it is published and never reallocated, so whoever holds a reference can
+// read [0, capacity) for as long as they hold it. Files are decoded into a
+// new object on the UI thread and handed to the engine through
+// Granular::pendingSample; the engine publishes the one it is playing
+// through Granular::publishedSample for the display. Only the engine writes
+// into the data, and only while recording.
+struct GranularSample {
+    enum Format {
+        FORMAT_FLOAT,
+        FORMAT_INT16,
+        FORMAT_HALF,
+        NUM_FORMATS
+    };
+    Format format;
+    // Only the vector for `format` is allocated, capacity + PADDING
+    // samples long
+    std::vector<float> data;
+    std::vector<int16_t> pcm16;
+    std::vector<Half> half;
+    // Applied to converted samples: full scale / 32767 for int16, else 1
+    float scale = 1.f;
+    size_t capacity;
+    unsigned int sampleRate;
+    // Recordings hold input voltages, files hold +-1
+    bool rawVoltage;
+    // Source file, empty for recordings
+    std::string path;
+    // Position in the module's sample folder, -1 if not from a folder
+    int folderIndex = -1;
+    // Granular::sampleGeneration of the load that produced it
+    uint32_t generation = 0;
+    // Usable length. Fixed for files, set by the engine when a recording stops.
+    std::atomic<size_t> length{0};
+    // Zeros past the capacity, for the second interpolation tap of a read
+    // at the last sample
+    static const int PADDING = 1;
+
+    // fullScale is the largest magnitude int16 storage has to hold
+    GranularSample(size_t capacity, unsigned int sampleRate, bool rawVoltage, Format format = FORMAT_FLOAT, float fullScale = 1.f)
+        : format(format), capacity(capacity), sampleRate(sampleRate), rawVoltage(rawVoltage) {
+        size_t size = capacity + PADDING;
+        switch (format) {
+            case FORMAT_INT16:
+                pcm16.assign(size, 0);
+                scale = fullScale / 32767.f;
+                break;
+            case FORMAT_HALF:
+                half.assign(size, Half{0});
+                break;
+            default:
+                data.assign(size, 0.f);
+                break;
+        }
+    }
+
+    // Calls f with the typed storage pointer and returns its result
+    template <typename F>
+    auto visit(F f) {
+        switch (format) {
+            case FORMAT_INT16: return f(pcm16.data());
+            case FORMAT_HALF: return f(half.data());
+            default: return f(data.data());
+        }
+    }
+
+    template <typename F>
+    auto visit(F f) const {
+        switch (format) {
+            case FORMAT_INT16: return f((const int16_t*)pcm16.data());
+            case FORMAT_HALF: return f((const Half*)half.data());
+            default: return f((const float*)data.data());
+        }
+    }
+
+    // Single-sample access for the non-realtime paths
+    float get(size_t i) const {
+        return visit([&](const auto* buffer) { return sampleToFloat(buffer[i]); }) * scale;
+    }
+
+    void set(size_t i, float v) {
+        visit([&](auto* buffer) { storeSample(buffer[i], v / scale); });
+    }
+
+    void clear() {
+        std::fill(data.begin(), data.end(), 0.f);
+        std::fill(pcm16.begin(), pcm16.end(), 0);
+        std::fill(half.begin(), half.end(), Half{0});
+    }
+};
+
+// --- TRIPLE BUFFER ---
+// Single-producer, single-consumer handoff of a whole struct. The writer
+// fills its back slot and swaps it with the middle one; the reader swaps
+// the middle slot into its front whenever a new one is flagged. Neither
+// side waits, and the reader always sees one complete value.
+template <typename T>
+struct TripleBuffer {
+    static const int NEW_BIT = 4;
+
+    T slots[3] = {};
+    // Index of the middle slot, with NEW_BIT set while it is unread
+    std::atomic<int> middle{1};
+    int back = 0;
+    int front = 2;
+
+    T& getWriteBuffer() {
+        return slots[back];
+    }
+
+    void publish() {
+        back = middle.exchange(back | NEW_BIT, std::memory_order_acq_rel) & (NEW_BIT - 1);
+    }
+
+    // The latest published value, or the previous one if nothing new came
+    const T& read() {
+        if (middle.load(std::memory_order_relaxed) & NEW_BIT) {
+            front = middle.exchange(front, std::memory_order_acq_rel) & (NEW_BIT - 1);
+        }
+        return slots[front];
+    }
+};
+
+// --- PITCH TRACKER ---
+// Estimates the source period around a buffer position for the
+// formant-preserving mode: an AMDF over every lag on a decimated window,
+// refined on the full window around the best lag. The search is spread over
+// many samples, LAGS_PER_STEP lags per step, so no single one pays for it.
+struct PitchTracker {
+    static const int WINDOW = 512;
+    static const int DECIMATION = 4;
+    static constexpr float MIN_HZ = 50.f;
+    static constexpr float MAX_HZ = 1000.f;
+    // Largest difference, relative to the window's mean level, still taken as periodic
+    static constexpr float VOICING = 0.35f;
+    static const int MAX_LAGS = 4096;
+    // Two coarse lags cost about one refined lag. Finishes well within
+    // FORMANT_DIVISION samples up to 96 kHz.
+    static const int LAGS_PER_STEP = 2;
+
+    enum Stage { IDLE, COARSE, REFINE };
+    Stage stage = IDLE;
+    // Window start in the buffer
+    size_t offset = 0;
+    int minLag = 0;
+    int maxLag = 0;
+    int lag = 0;
+    float level = 0.f;
+    float dMin = INFINITY;
+    float dBest = INFINITY;
+    int refined = 0;
+    int refineEnd = 0;
+    float coarse[MAX_LAGS];
+
+    template <typename T>
+    static float difference(const T* x, int lag, int step) {
+        float d = 0.f;
+        for (int i = 0; i < WINDOW; i += step) {
+            d += std::abs(sampleToFloat(x[i]) - sampleToFloat(x[i + lag]));
+        }
+        return d * step / WINDOW;
+    }
+
+    bool isBusy() const { return stage != IDLE; }
+
+    // For a buffer that was replaced; the window offset would be stale.
+    void reset() { stage = IDLE; }
+
+    // Starts an estimate at pos. Returns false if there is nothing to
+    // search, a window too short or silent; the period is then 0. Only the
+    // silence floor depends on the storage scale.
+    template <typename T>
+    bool begin(const T* buffer, size_t len, size_t pos, float sampleRate, float scale = 1.f) {
+        stage = IDLE;
+        minLag = std::max(2, (int)(sampleRate / MAX_HZ));
+        maxLag = std::min((int)(sampleRate / MIN_HZ), minLag + MAX_LAGS - 1);
+        if (len < (size_t)(WINDOW + maxLag + 1)) return false;
+        offset = std::min(pos, len - WINDOW - maxLag - 1);
+        const T* x = buffer + offset;
+
+        level = 0.f;
+        for (int i = 0; i < WINDOW; i += DECIMATION) level += std::abs(sampleToFloat(x[i]));
+        level *= (float)DECIMATION / WINDOW;
+        if (level * scale < 1e-4f) return false;
+
+        lag = minLag;
+        dMin = INFINITY;
+        stage = COARSE;
+        return true;
+    }
+
+    // Runs the next part of the search on the buffer passed to begin.
+    // Returns true once done, with the period in samples in `period`, or 0
+    // if the window is not clearly periodic.
+    template <typename T>
+    bool step(const T* buffer, float& period) {
+        const T* x = buffer + offset;
+        if (stage == COARSE) {
+            for (int k = 0; k < LAGS_PER_STEP && lag <= maxLag; k++, lag++) {
+                float d = difference(x, lag, DECIMATION);
+                coarse[lag - minLag] = d;
+                if (d < dMin) dMin = d;
+            }
+            if (lag <= maxLag) return false;
+
+            // The difference also dips at multiples of the period, so take
+            // the shortest lag close to the deepest dip
+            int best = minLag;
+            for (int k = 0; k <= maxLag - minLag; k++) {
+                if (coarse[k] <= dMin + 0.1f * level) {
+                    best = minLag + k;
+                    break;
+                }
             }
+            lag = std::max(minLag, best - 2);
+            refineEnd = std::min(maxLag, best + 2);
+            refined = best;
+            dBest = INFINITY;
+            stage = REFINE;
+            return false;
         }
-        else if (bufferPos < loopStart) {
-            bufferPos = loopStart;
+        if (stage == REFINE) {
+            float d = difference(x, lag, 1);
+            if (d < dBest) {
+                dBest = d;
+                refined = lag;
+            }
+            if (++lag <= refineEnd) return false;
+            stage = IDLE;
+            period = dBest > VOICING * level ? 0.f : (float)refined;
+            return true;
         }
-        life += lifeIncrement;
+        return false;
+    }
+};
+
+// --- GRAIN SCHEDULER ---
+// Decides what happens when a spawn would go over the grain budget, and in
+// adaptive mode scales the effective density down while rendering takes
+// more than the target share of each block.
+struct GrainScheduler {
+    enum StealPolicy { STEAL_NONE, STEAL_OLDEST, STEAL_QUIETEST, STEAL_NEAREST_END, NUM_STEAL_POLICIES };
+    static const int BLOCK_SIZE = 256;
+    // Room for grains that are still fading out after being stolen
+    static const int RELEASE_HEADROOM = 32;
+    static constexpr float FADE_SECONDS = 0.005f;
+
+    // Settings, written from the UI thread
+    int budget = 128;
+    int policy = STEAL_NONE;
+    bool adaptive = false;
+    float targetLoad = 0.25f;
+
+    // Engine thread state
+    float densityScale = 1.f;
+    uint32_t nextBirth = 0;
+    int64_t renderNs = 0;
+    int blockSamples = 0;
+
+    // Published once per block for the UI
+    std::atomic<float> load{0.f};
+    std::atomic<float> publishedScale{1.f};
+    std::atomic<uint64_t> steals{0};
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    int pickVictim(std::vector<Grain>& grains) {
+        int victim = -1;
+        float best = 0.f;
+        for (int i = 0; i < (int)grains.size(); i++) {
+            Grain& g = grains[i];
+            if (g.isReleasing()) continue;
+            float score;
+            if (policy == STEAL_OLDEST) {
+                // Wrap-safe age
+                score = (float)(nextBirth - g.birth);
+            }
+            else if (policy == STEAL_QUIETEST) {
+                score = -g.getEnvelope(g.finalEnvShape);
+            }
+            else {
+                score = g.life;
+            }
+            if (victim < 0 || score > best) {
+                victim = i;
+                best = score;
+            }
+        }
+        return victim;
+    }
+
+    // Returns true if a new grain may be pushed, stealing one if the policy allows.
+    bool admit(std::vector<Grain>& grains, int capacity, float sampleRate) {
+        if ((int)grains.size() >= capacity) return false;
+        if ((int)grains.size() < budget) return true;
+
+        int active = 0;
+        for (const Grain& g : grains) {
+            if (!g.isReleasing()) active++;
+        }
+        if (active < budget) return true;
+        if (policy == STEAL_NONE) return false;
+
+        int victim = pickVictim(grains);
+        if (victim < 0) return false;
+        grains[victim].release(FADE_SECONDS * sampleRate);
+        steals++;
+        return true;
+    }
+
+    // Called once per sample with the time spent rendering grains.
+    void addRenderTime(int64_t ns, float sampleRate) {
+        renderNs += ns;
+        if (++blockSamples < BLOCK_SIZE) return;
+
+        float blockLoad = renderNs * 1e-9f * sampleRate / BLOCK_SIZE;
+        if (blockLoad > targetLoad) {
+            densityScale = std::max(densityScale * 0.9f, 0.05f);
+        }
+        else if (blockLoad < targetLoad * 0.7f) {
+            densityScale = std::min(densityScale * 1.05f, 1.f);
+        }
+        load = blockLoad;
+        publishedScale = densityScale;
+        renderNs = 0;
+        blockSamples = 0;
+    }
+
+    void resetAdaptive() {
+        densityScale = 1.f;
+        publishedScale = 1.f;
+        load = 0.f;
+        renderNs = 0;
+        blockSamples = 0;
+    }
+
+    // While a clock drives spawning, onsets come from division crossings
+    // rather than the timer, so they are thinned here instead: each
+    // crossing adds densityScale to a credit and spawns once it reaches 1,
+    // keeping that share of the onsets spread evenly through the train.
+    float clockCredit = 0.f;
+
+    bool keepClockedOnset() {
+        clockCredit += densityScale;
+        if (clockCredit < 1.f) return false;
+        clockCredit -= 1.f;
+        return true;
+    }
+
+    // The first crossing after a reset spawns, so the train restarts on
+    // the beat.
+    void restartClocked() {
+        clockCredit = 1.f - densityScale;
     }
 
-    bool isAlive() { return life < 1.f; }
+    // --- BLOCK PLANNING ---
+    // Optionally the free-running spawn timer runs once per PLAN_BLOCK
+    // samples instead of every sample: every onset of the block is listed in
+    // one pass at the density of the block's first sample, and handed out as
+    // each sample comes due. Onsets land exactly where the per-sample timer
+    // puts them at a steady density; density changes take effect at block
+    // boundaries.
+    static const int PLAN_BLOCK = 32;
+    static const int MAX_PLANNED = 128;
+
+    // Setting, written from the UI thread
+    bool planBlocks = false;
+
+    // Engine thread state. Onsets are in samples from the block start.
+    float planned[MAX_PLANNED];
+    int numPlanned = 0;
+    int nextPlanned = 0;
+    // Samples of the block already run, 0 when none is planned
+    int planPosition = 0;
+
+    // timer is the seconds until the next onset as of the start of this
+    // sample, as the per-sample timer keeps it. It comes back as of the
+    // start of the next block.
+    void planBlock(double& timer, double interval, float sampleRate) {
+        // A density increase takes effect now rather than after the
+        // pending long period
+        double t = std::min(timer, interval) * sampleRate;
+        double step = interval * sampleRate;
+        numPlanned = 0;
+        nextPlanned = 0;
+        while (t <= PLAN_BLOCK) {
+            if (numPlanned == MAX_PLANNED) {
+                // Far behind, restart the train at the next block
+                t = PLAN_BLOCK;
+                break;
+            }
+            planned[numPlanned++] = (float)t;
+            t += step;
+        }
+        timer = (t - PLAN_BLOCK) / sampleRate;
+    }
+
+    // Onsets due by the end of this sample, as samples late, as the
+    // per-sample timer reports them. Beyond maxOnsets they are dropped.
+    int takeDue(float* onsets, int maxOnsets) {
+        planPosition++;
+        int count = 0;
+        while (nextPlanned < numPlanned && planned[nextPlanned] <= planPosition) {
+            float late = planPosition - planned[nextPlanned++];
+            if (count < maxOnsets) onsets[count++] = late;
+        }
+        if (planPosition == PLAN_BLOCK) planPosition = 0;
+        return count;
+    }
+
+    // Hands the rest of a planned block back to the per-sample timer, for
+    // the clock taking over or planning being switched off mid-block.
+    void leaveBlock(double& timer, float sampleTime) {
+        if (planPosition == 0) return;
+        double next = nextPlanned < numPlanned ? planned[nextPlanned] : PLAN_BLOCK + timer / sampleTime;
+        timer = (next - planPosition) * sampleTime;
+        planPosition = 0;
+    }
 };
 
+// --- CLOCK TRACKING ---
+// Follows an external clock with a simple PLL: the pulse period is smoothed
+// on every edge and the beat phase is pulled towards the edge count, so the
+// sync divisions lock to the rack clock instead of the BPM knob.
+struct ClockTracker {
+    // Every sync division divides the longest one, so the phase wraps there
+    static constexpr double PHASE_WRAP = 4.0;
+    static constexpr double PERIOD_GAIN = 0.25;
+    static constexpr double PHASE_GAIN = 0.5;
+
+    int ppqn = 1;
+
+    dsp::SchmittTrigger clockTrigger;
+    dsp::SchmittTrigger resetTrigger;
+    bool hasEdge = false;
+    double period = 0.0; // Samples per pulse, 0 until two edges are seen
+    double samplesSinceEdge = 0.0;
+    int pulseCount = 0;
+    double phase = 0.0; // Beats
+    double prevPhase = 0.0;
+
+    std::atomic<float> bpm{0.f};
+
+    bool isLocked() const { return period > 0.0 && samplesSinceEdge < period * 4.0; }
+
+    float getBpm(float sampleRate) const { return (float)(60.0 * sampleRate / (period * ppqn)); }
+
+    static double wrapError(double error) {
+        if (error >= PHASE_WRAP * 0.5) error -= PHASE_WRAP;
+        else if (error < -PHASE_WRAP * 0.5) error += PHASE_WRAP;
+        return error;
+    }
+
+    // Advances one sample. Returns true on a reset edge.
+    bool process(float clockVoltage, float resetVoltage, float sampleRate) {
+        prevPhase = phase;
+        if (isLocked()) {
+            phase += 1.0 / (period * ppqn);
+        }
+        samplesSinceEdge += 1.0;
+
+        bool reset = resetTrigger.process(resetVoltage, 0.1f, 1.f);
+        if (reset) {
+            // The next clock edge is the downbeat; back prevPhase off so the
+            // grid point at zero fires now.
+            pulseCount = -1;
+            phase = 0.0;
+            prevPhase = -1e-9;
+        }
+
+        if (clockTrigger.process(clockVoltage, 0.1f, 1.f)) {
+            bool wasLocked = isLocked();
+            if (hasEdge) {
+                double measured = samplesSinceEdge;
+                if (wasLocked && measured > period * 0.5 && measured < period * 2.0)
+                    period += PERIOD_GAIN * (measured - period);
+                else
+                    period = measured;
+                bpm = getBpm(sampleRate);
+            }
+            hasEdge = true;
+            samplesSinceEdge = 0.0;
+
+            pulseCount = (pulseCount + 1) % (ppqn * (int)PHASE_WRAP);
+            double error = wrapError((double)pulseCount / ppqn - phase);
+            phase += wasLocked ? PHASE_GAIN * error : error;
+        }
+
+        if (phase >= PHASE_WRAP) phase -= PHASE_WRAP;
+        else if (phase < 0.0) phase += PHASE_WRAP;
+        return reset;
+    }
+
+    // True if the phase moved forward across a multiple of division (in
+    // beats) this sample; lateSamples is how far past it the phase now is.
+    bool crossedDivision(double division, float& lateSamples) const {
+        double delta = wrapError(phase - prevPhase);
+        if (delta <= 0.0 || division <= 0.0) return false;
+        double end = prevPhase + delta;
+        double grid = std::floor(end / division) * division;
+        if (grid <= prevPhase) return false;
+        double beatsPerSample = 1.0 / (period * ppqn);
+        lateSamples = (float)std::min((end - grid) / beatsPerSample, 0.999);
+        return true;
+    }
+};
+
+// --- OUTPUT SATURATOR ---
+// Polyphase FIR resampler pair for running a nonlinearity at FACTOR times
+// the engine rate. Both directions share one windowed-sinc kernel split
+// into FACTOR phases of TAPS taps, so each output only touches the taps
+// that line up with real (not zero-stuffed) samples.
+template <int FACTOR>
+struct PolyphaseOversampler {
+    static const int TAPS = 32; // Per phase
+    // Cutoff as a fraction of the engine Nyquist
+    static constexpr float CUTOFF = 0.9f;
+
+    // kernel[p][j] = h[j * FACTOR + p]
+    float kernel[FACTOR][TAPS];
+    // Histories are written twice so TAPS consecutive reads never wrap.
+    // Index 0 is the newest sample.
+    float upHistory[2 * TAPS];
+    float downHistory[FACTOR][2 * TAPS];
+    int upIndex = 0;
+    int downIndex = 0;
+
+    PolyphaseOversampler() {
+        float h[FACTOR * TAPS];
+        dsp::boxcarLowpassIR(h, FACTOR * TAPS, CUTOFF * 0.5f / FACTOR);
+        dsp::blackmanHarrisWindow(h, FACTOR * TAPS);
+        // Each phase at unity DC gain, so the zero-stuffed upsampler keeps
+        // its level and the decimator (the sum of all phases) gets 1/FACTOR.
+        for (int p = 0; p < FACTOR; p++) {
+            float sum = 0.f;
+            for (int j = 0; j < TAPS; j++) sum += h[j * FACTOR + p];
+            for (int j = 0; j < TAPS; j++) kernel[p][j] = h[j * FACTOR + p] / sum;
+        }
+        reset();
+    }
+
+    void reset() {
+        std::fill(std::begin(upHistory), std::end(upHistory), 0.f);
+        for (int p = 0; p < FACTOR; p++)
+            std::fill(std::begin(downHistory[p]), std::end(downHistory[p]), 0.f);
+        upIndex = 0;
+        downIndex = 0;
+    }
+
+    static float dot(const float* a, const float* b) {
+        float sum = 0.f;
+        for (int j = 0; j < TAPS; j++) sum += a[j] * b[j];
+        return sum;
+    }
+
+    // One engine-rate sample in, FACTOR samples out
+    void upsample(float in, float* out) {
+        upIndex = (upIndex + TAPS - 1) % TAPS;
+        upHistory[upIndex] = upHistory[upIndex + TAPS] = in;
+        for (int p = 0; p < FACTOR; p++)
+            out[p] = dot(kernel[p], &upHistory[upIndex]);
+    }
+
+    // FACTOR samples in, oldest first, one engine-rate sample out
+    float downsample(const float* in) {
+        downIndex = (downIndex + TAPS - 1) % TAPS;
+        float out = 0.f;
+        for (int p = 0; p < FACTOR; p++) {
+            // Phase p sees the sample p steps before the newest one
+            float* history = downHistory[p];
+            history[downIndex] = history[downIndex + TAPS] = in[FACTOR - 1 - p];
+            out += dot(kernel[p], &history[downIndex]);
+        }
+        return out / FACTOR;
+    }
+};
+
+// Output soft clipper: a [7/6] Pade approximant of tanh, within 1e-4 of
+// std::tanh and clamped where it reaches 1. Optionally oversampled so the
+// harmonics it adds to loud signals do not alias back down.
+struct OutputSaturator {
+    static constexpr float CLIP = 4.97f;
+
+    // 1, 2 or 4. Written from the UI; the audio thread resets the
+    // resampler it switches to.
+    int oversample = 1;
+    int activeOversample = 1;
+    PolyphaseOversampler<2> x2;
+    PolyphaseOversampler<4> x4;
+
+    static float tanh(float x) {
+        x = rack::math::clamp(x, -CLIP, CLIP);
+        float x2 = x * x;
+        return x * (135135.f + x2 * (17325.f + x2 * (378.f + x2)))
+            / (135135.f + x2 * (62370.f + x2 * (3150.f + x2 * 28.f)));
+    }
+
+    float process(float in) {
+        if (oversample != activeOversample) {
+            activeOversample = oversample;
+            x2.reset();
+            x4.reset();
+        }
+        float buffer[4];
+        switch (activeOversample) {
+            case 2:
+                x2.upsample(in, buffer);
+                for (int i = 0; i < 2; i++) buffer[i] = tanh(buffer[i]);
+                return x2.downsample(buffer);
+            case 4:
+                x4.upsample(in, buffer);
+                for (int i = 0; i < 4; i++) buffer[i] = tanh(buffer[i]);
+                return x4.downsample(buffer);
+            default:
+                return tanh(in);
+        }
+    }
+};
+
+// --- GRAIN-COUNT NORMALISATION ---
+// Scales the grain sum by 1/sqrt of the live grain count. The count is
+// slewed and the gain recomputed once per BLOCK, then ramped across the
+// next block, so grains being born and dying do not step the level.
+struct GrainNormalizer {
+    static const int BLOCK = 32;
+    // Rises quickly so a burst of new grains is caught, falls slowly so
+    // the tail of a cloud is not pumped up
+    static constexpr float RISE_SECONDS = 0.005f;
+    static constexpr float FALL_SECONDS = 0.05f;
+
+    float sampleRate = 0.f;
+    float riseCoef = 1.f;
+    float fallCoef = 1.f;
+
+    float count = 1.f;
+    float gain = 1.f;
+    float step = 0.f;
+    int blockPos = 0;
+
+    void setSampleRate(float newSampleRate) {
+        sampleRate = newSampleRate;
+        riseCoef = 1.f - std::exp(-BLOCK / (RISE_SECONDS * sampleRate));
+        fallCoef = 1.f - std::exp(-BLOCK / (FALL_SECONDS * sampleRate));
+    }
+
+    float process(float in, size_t grainCount, float newSampleRate) {
+        if (newSampleRate != sampleRate) setSampleRate(newSampleRate);
+        float out = in * gain;
+        gain += step;
+        if (++blockPos >= BLOCK) {
+            blockPos = 0;
+            float target = std::max((float)grainCount, 1.f);
+            count += (target > count ? riseCoef : fallCoef) * (target - count);
+            float nextGain = 1.f / std::sqrt(count);
+            step = (nextGain - gain) / BLOCK;
+        }
+        return out;
+    }
+};
+
+// --- OUTPUT DYNAMICS ---
+// Feed-forward compressor followed by a lookahead peak limiter. Peaks are
+// collected per sample, but both gains are computed once per BLOCK and
+// ramped linearly across the next one. The audio is delayed by LOOKAHEAD
+// so each block's gain ramp is known to stay under the ceiling before the
+// block is played. With the amount at 0 the stage is bypassed, latency
+// included, so patches from before it keep their sound and timing.
+struct OutputDynamics {
+    static const int BLOCK = 32;
+    static const int LOOKAHEAD = 2 * BLOCK;
+    // Limiter ceiling at the saturator input, leaving it only the top few
+    // dB to round off
+    static constexpr float CEILING = 2.f;
+    static constexpr float ATTACK_SECONDS = 0.005f;
+    static constexpr float RELEASE_SECONDS = 0.15f;
+    static constexpr float LIMIT_RELEASE_SECONDS = 0.05f;
+
+    float delay[LOOKAHEAD] = {};
+    int delayIndex = 0;
+    int blockPos = 0;
+    float blockPeak = 0.f;
+    float prevBlockPeak = 0.f;
+
+    float sampleRate = 0.f;
+    float attackCoef = 1.f;
+    float releaseCoef = 1.f;
+    float limitReleaseCoef = 1.f;
+
+    float envelope = 0.f;
+    // Compressor gain of the last three input blocks, oldest first
+    float compGains[3] = {1.f, 1.f, 1.f};
+    float compGain = 1.f;
+    float compStep = 0.f;
+    float limitGain = 1.f;
+    float limitStep = 0.f;
+    float limitTarget = 1.f;
+    // Share of the processed signal in the output, ramped over a block
+    // when the stage is switched in or out
+    float mix = 0.f;
+
+    // Gain reduction of the last block in dB, for the context menu
+    std::atomic<float> reductionDb{0.f};
+
+    void setSampleRate(float newSampleRate) {
+        sampleRate = newSampleRate;
+        attackCoef = 1.f - std::exp(-BLOCK / (ATTACK_SECONDS * sampleRate));
+        releaseCoef = 1.f - std::exp(-BLOCK / (RELEASE_SECONDS * sampleRate));
+        limitReleaseCoef = 1.f - std::exp(-BLOCK / (LIMIT_RELEASE_SECONDS * sampleRate));
+    }
+
+    // Static curve: threshold falls and ratio rises with the knob, with
+    // makeup bringing a full-scale input back to full scale, so turning it
+    // up drives quieter material harder.
+    static float computeGain(float level, float amount) {
+        float thresholdDb = -6.f - 24.f * amount;
+        float slope = 1.f - 1.f / (1.f + 7.f * amount);
+        float makeupDb = -thresholdDb * slope;
+        float levelDb = 20.f * std::log10(std::max(level, 1e-6f));
+        float reductionDb = std::max(levelDb - thresholdDb, 0.f) * slope;
+        return std::pow(10.f, (makeupDb - reductionDb) / 20.f);
+    }
+
+    // Called once the input block that just filled is known. Sets up the
+    // ramps for the output block before it.
+    void updateGains(float amount) {
+        float attack = blockPeak > envelope ? attackCoef : releaseCoef;
+        envelope += attack * (blockPeak - envelope);
+        compGains[0] = compGains[1];
+        compGains[1] = compGains[2];
+        compGains[2] = computeGain(envelope, amount);
+
+        // The output block ramps compGains[0] -> [1]; the one after it
+        // [1] -> [2]. Both must stay under the ceiling by the end of this ramp.
+        compGain = compGains[0];
+        compStep = (compGains[1] - compGains[0]) / BLOCK;
+        limitGain = limitTarget;
+        float outPeak = prevBlockPeak * std::max(compGains[0], compGains[1]);
+        float nextPeak = blockPeak * std::max(compGains[1], compGains[2]);
+        float target = limitGain + limitReleaseCoef * (1.f - limitGain);
+        if (outPeak > CEILING) target = std::min(target, CEILING / outPeak);
+        if (nextPeak > CEILING) target = std::min(target, CEILING / nextPeak);
+        limitStep = (target - limitGain) / BLOCK;
+        limitTarget = target;
+
+        reductionDb = -20.f * std::log10(std::max(compGains[1] * target, 1e-6f) / computeGain(0.f, amount));
+        prevBlockPeak = blockPeak;
+        blockPeak = 0.f;
+    }
+
+    // amount is the COMPRESSION knob, 0 to 1. Output lags input by
+    // LOOKAHEAD unless the amount is 0.
+    float process(float in, float amount, float newSampleRate) {
+        if (newSampleRate != sampleRate) setSampleRate(newSampleRate);
+
+        float out = delay[delayIndex] * compGain * limitGain;
+        delay[delayIndex] = in;
+        if (++delayIndex >= LOOKAHEAD) delayIndex = 0;
+        compGain += compStep;
+        limitGain += limitStep;
+
+        blockPeak = std::max(blockPeak, std::fabs(in));
+        if (++blockPos >= BLOCK) {
+            blockPos = 0;
+            updateGains(amount);
+        }
+
+        float target = amount > 0.f ? 1.f : 0.f;
+        if (mix != target) {
+            mix = target > mix ? std::min(mix + 1.f / BLOCK, 1.f) : std::max(mix - 1.f / BLOCK, 0.f);
+        }
+        if (mix == 0.f) {
+            reductionDb = 0.f;
+            return in;
+        }
+        return in + (out - in) * mix;
+    }
+};
+
+static const int OVERSAMPLE_FACTORS[] = {1, 2, 4};
+static const int NUM_OVERSAMPLE_FACTORS = 3;
+
+static const int CLOCK_PPQN[] = {1, 2, 4, 24};
+static const int NUM_CLOCK_PPQN = 4;
+
+static const int GRAIN_BUDGETS[] = {16, 32, 64, 128};
+static const int NUM_GRAIN_BUDGETS = 4;
+static const float ADAPTIVE_TARGETS[] = {0.05f, 0.1f, 0.25f, 0.5f};
+static const int NUM_ADAPTIVE_TARGETS = 4;
+
 
 struct Granular : Module {
     enum ParamId {
@@ -169,6 +1123,11 @@ struct Granular : Module {
         LIVE_REC_PARAM,
         BPM_PARAM,
         SYNC_PARAM,
+        DIRECTION_PARAM,
+        R_DIRECTION_PARAM,
+        SCAN_PARAM,
+        PREV_FILE_PARAM,
+        NEXT_FILE_PARAM,
         PARAMS_LEN
     };
     enum InputId {
@@ -178,8 +1137,16 @@ struct Granular : Module {
         M_ENV_SHAPE_INPUT,
         M_POSITION_INPUT,
         M_PITCH_INPUT,
+        CLOCK_INPUT,
+        RESET_INPUT,
+        NEXT_FILE_INPUT,
         INPUTS_LEN
     };
+    enum Direction {
+        DIRECTION_FORWARD,
+        DIRECTION_REVERSE,
+        DIRECTION_PING_PONG
+    };
     enum OutputId {
         SINE_OUTPUT,
         OUTPUTS_LEN
@@ -241,29 +1208,324 @@ struct Granular : Module {
         }
     };
 
-    std::vector<float> audioBuffer;
+    // The sample being played, engine thread only. recordSample is kept
+    // between recordings so its buffer is only allocated once.
+    std::shared_ptr<GranularSample> sample;
+    std::shared_ptr<GranularSample> recordSample;
+    // Handoff slots, only accessed through std::atomic_load/store/exchange:
+    // UI to engine and engine to display. libstdc++ guards these with a
+    // small pool of mutexes held only for the pointer copy, so they are
+    // short but not lock-free; the engine touches them only on a change
+    // of sample.
+    std::shared_ptr<GranularSample> pendingSample;
+    std::shared_ptr<GranularSample> publishedSample;
+    std::atomic<bool> samplePending{false};
+    // Samples the engine stopped playing, handed back through a ring so
+    // the last reference is never released on the audio thread. The widget
+    // drains it every frame, after looking for folder files to restage.
+    // An upkeep on the SampleLoadPool drains it too when no widget has for
+    // a while, or when it is half full, so a headless or hidden module
+    // never runs out of room. The engine defers a change of sample while
+    // it is full, which is at most one upkeep period.
+    static const uint32_t RETIRE_SLOTS = 16;
+    static constexpr double RETIRE_UI_TIMEOUT = 0.25;
+    std::shared_ptr<GranularSample> retiredSamples[RETIRE_SLOTS];
+    std::atomic<uint32_t> retireWrite{0};
+    std::atomic<uint32_t> retireRead{0};
+    // Serialises the two readers of the ring, never taken by the engine
+    std::mutex retireMutex;
+    std::atomic<double> lastUiCollect{0.0};
+    // Bumped by the UI each time it asks for a different sample. Loads
+    // finishing for an older generation were cancelled or superseded, and
+    // the engine drops them.
+    std::atomic<uint32_t> sampleGeneration{0};
+
+    // GranularSample::Format for samples loaded or recorded from now on.
+    // Read by the UI, loader and engine threads.
+    std::atomic<int> storageFormat{GranularSample::FORMAT_FLOAT};
+
+    // Cached from the playing sample
     unsigned int fileSampleRate = 44100;
-
     size_t activeBufferLen = 0;
-    bool bufferIsRawVoltage = false;
+    // Source samples per engine sample at the original pitch, so a file
+    // plays at its own pitch and speed whatever the engine rate
+    float engineSampleRate = 44100.f;
+    double rateRatio = 1.0;
 
     std::vector<Grain> grains;
     static const int MAX_GRAINS = 128;
-    float grainSpawnTimer = 0.f;
+    // What the display needs of each grain, published every
+    // SNAPSHOT_DIVISION samples so the UI never touches the grain vector
+    struct GrainSnapshot {
+        struct Marker {
+            // Fraction of the sample length
+            float position;
+            // Envelope times release fade, 0 to 1
+            float level;
+        };
+        int count;
+        Marker markers[MAX_GRAINS];
+    };
+    static const int SNAPSHOT_DIVISION = 512;
+    dsp::ClockDivider snapshotDivider;
+    TripleBuffer<GrainSnapshot> grainSnapshot;
+    GrainScheduler scheduler;
+    ClockTracker clock;
+    GrainNormalizer normalizer;
+    OutputDynamics dynamics;
+    OutputSaturator saturator;
+
+    // Each new grain takes the next channel of the polyphonic mod inputs
+    int nextModChannel = 0;
+    bool pitchFm = false;
+    bool positionFm = false;
+    float pitchFmRatio[PORT_MAX_CHANNELS];
+    float positionFmOffset[PORT_MAX_CHANNELS];
+
+    // Latch at spawn (false) or track continuously (true), per parameter
+    bool trackPitch = false;
+    bool trackShape = false;
+    bool trackSize = false;
+    bool trackLoop = true;
+    static const int TRACK_DIVISION = 32;
+    dsp::ClockDivider trackDivider;
+    // What the last tracking pass wrote; it is skipped until one moves.
+    // A grain spawned with other values clears loopTracked or trackedMask.
+    bool loopTracked = false;
+    double trackedLoopStart = 0.0;
+    double trackedLoopEnd = 0.0;
+    // Bit 0 pitch, 1 shape, 2 size
+    int trackedMask = 0;
+    int trackedChannels = 0;
+    bool trackedSynced = false;
+    float trackedSecondsPerBeat = 0.f;
+    double trackedRateRatio = 1.0;
+    float trackedPitchVolts[PORT_MAX_CHANNELS] = {};
+    float trackedShapeBase[PORT_MAX_CHANNELS] = {};
+    float trackedSizeBase[PORT_MAX_CHANNELS] = {};
+
+    // Time-stretch: the spawn position runs through the loop at the SCAN
+    // rate, independent of grain pitch. scanOffset is added to the
+    // Position knob, in source samples.
+    bool timeStretch = false;
+    double scanOffset = 0.0;
+
+    // Formant preservation: grains play at the source speed, two source
+    // periods long, and are spawned at the target pitch period instead.
+    bool preserveFormants = false;
+    static const int FORMANT_DIVISION = 2048;
+    dsp::ClockDivider formantDivider;
+    float formantPeriod = 0.f;
+    PitchTracker pitchTracker;
+    // Seconds until the next onset. Kept in double and carried over between
+    // periods so long synced trains do not drift against the BPM grid.
+    double grainSpawnTimer = 0.0;
+    static const int MAX_SPAWNS_PER_SAMPLE = 4;
     float grainSpawnPosition = 0.f;
 
     std::atomic<bool> isLoading{false};
     std::atomic<bool> isRecording{false};
 
+    // --- PERSISTENCE ---
+    // Files are saved by path. A recording is written to the patch storage
+    // directory when the patch is saved, only if it changed since the last
+    // save. At patch open both are queued on the shared SampleLoadPool, ahead
+    // of other modules once this one is patched or on screen.
+    static constexpr const char* RECORDING_FILENAME = "recording.wav";
+    // Voltage at full scale in the saved recording
+    static constexpr float RECORDING_FULL_SCALE = 10.f;
+    static const int LOAD_PRIORITY_VISIBLE = 1;
+    static const int LOAD_PRIORITY_CONNECTED = 2;
+    std::atomic<bool> recordingDirty{false};
+    // Bumped before a recording reuses the record buffer, so a save can
+    // tell its copy was torn
+    std::atomic<uint32_t> recordingStarts{0};
+    std::shared_ptr<SampleLoadPool::Job> loadJob;
+    // What is being loaded, so a save during the load keeps it
+    std::string loadingPath;
+    bool loadingRecording = false;
+
+    // --- SAMPLE FOLDER ---
+    // A dropped directory is browsed with the file buttons and trigger
+    // input. The files either side of the current one are decoded on the
+    // SampleLoadPool ahead of time and staged, so the engine switches to
+    // them at once; a step past them keeps playing the old file until the
+    // new one is decoded.
+    enum StagedSlot {
+        STAGED_PREV,
+        STAGED_NEXT,
+        NUM_STAGED
+    };
+    // Jumps the queue ahead of patch-open loads, the user is waiting
+    static const int LOAD_PRIORITY_FOLDER = LOAD_PRIORITY_VISIBLE + LOAD_PRIORITY_CONNECTED + 1;
+    // UI thread
+    std::string folderPath;
+    std::vector<std::string> folderFiles;
+    std::shared_ptr<SampleLoadPool::Job> prefetchJob;
+    // Folder index the last prefetch was planned around
+    int prefetchCenter = -1;
+    // Shared with the engine, which steps folderIndex
+    std::atomic<int> folderIndex{-1};
+    std::atomic<int> folderCount{0};
+    // Written by the prefetch job or UI, read by the engine
+    std::shared_ptr<GranularSample> stagedSamples[NUM_STAGED];
+    dsp::SchmittTrigger prevFileTrigger;
+    dsp::SchmittTrigger nextFileTrigger;
+    dsp::SchmittTrigger nextFileCvTrigger;
+    // Engine thread. Steps waiting for room in the retire ring.
+    int queuedFolderSteps = 0;
+
     size_t recHead = 0;
     bool wasRecordingPrev = false;
     bool bufferWrapped = false;
     dsp::SchmittTrigger recTrigger;
 
-    float getClampedRandomizedValue(float base_0_to_1, float r_knob_0_to_1) {
+#ifdef GRANULAR_PROFILE
+    GranularProfiler profiler;
+#endif
+
+    size_t getBufferCapacity() const {
+        return sample ? sample->capacity : 0;
+    }
+
+    float getRandomDeviation(float r_knob_0_to_1) {
         float max_deviation = r_knob_0_to_1 * 0.5f;
-        float random_offset = (rack::random::uniform() * 2.f - 1.f) * max_deviation;
-        return rack::math::clamp(base_0_to_1 + random_offset, 0.f, 1.f);
+        return (rack::random::uniform() * 2.f - 1.f) * max_deviation;
+    }
+
+    float getClampedRandomizedValue(float base_0_to_1, float r_knob_0_to_1) {
+        return rack::math::clamp(base_0_to_1 + getRandomDeviation(r_knob_0_to_1), 0.f, 1.f);
+    }
+
+    // --- PER-CHANNEL PARAMETER VALUES ---
+    // Knob plus modulation on one channel of the mod inputs, before the
+    // per-grain randomisation.
+
+    float getSizeBase(int channel) {
+        float size_raw = params[SIZE_PARAM].getValue();
+        float size_norm = rack::math::rescale(size_raw, 0.01f, 2.0f, 0.f, 1.f);
+        float size_mod_amount = params[M_SIZE_PARAM].getValue();
+        size_norm += inputs[M_SIZE_INPUT].getPolyVoltage(channel) * size_mod_amount * 0.1f;
+        return rack::math::clamp(size_norm, 0.f, 1.f);
+    }
+
+    float getShapeBase(int channel) {
+        float envShape = params[ENV_SHAPE_PARAM].getValue();
+        float shape_mod_amount = params[M_AMOUNT_ENV_SHAPE_PARAM].getValue();
+        envShape += inputs[M_ENV_SHAPE_INPUT].getPolyVoltage(channel) * shape_mod_amount * 0.1f;
+        return rack::math::clamp(envShape, 0.f, 1.f);
+    }
+
+    // Octaves from the pitch knob; the input is left out in FM mode
+    float getPitchVolts(int channel, bool pitchFmActive) {
+        float pitchKnob = params[PITCH_PARAM].getValue();
+        if (!pitchFmActive) {
+            float pitch_mod_amount = params[M_AMOUNT_PITCH_PARAM].getValue();
+            pitchKnob += inputs[M_PITCH_INPUT].getPolyVoltage(channel) * pitch_mod_amount * 0.1f;
+        }
+        pitchKnob = rack::math::clamp(pitchKnob, 0.f, 1.f);
+        return (pitchKnob - 0.5f) * 4.f;
+    }
+
+    static float getGrainSizeSeconds(float size_0_to_1, bool isSynced, float secondsPerBeat) {
+        if (isSynced) {
+            int index = (int)(size_0_to_1 * (NUM_SYNC_DIVS - 1) + 0.5f);
+            index = rack::math::clamp(index, 0, NUM_SYNC_DIVS - 1);
+            return secondsPerBeat * SYNC_DIVISIONS[index];
+        }
+        return rack::math::rescale(size_0_to_1, 0.f, 1.f, 0.01f, 2.0f);
+    }
+
+    float getLifeIncrement(float grainSize_sec) {
+        float grainSizeInSamples = grainSize_sec * engineSampleRate;
+        if (grainSizeInSamples < 1.f) grainSizeInSamples = 1.f;
+        return 1.f / grainSizeInSamples;
+    }
+
+    // Control-rate pass for the parameters set to track. Current values are
+    // worked out once per mod channel into small arrays, then written into
+    // every grain on top of its own spawn-time deviation, so nothing is read
+    // per grain per sample. Grains spawned since the last pass already hold
+    // the current values, so nothing is written while they stay put.
+    void updateTrackedGrains(double loopStartSamp, double loopEndSamp, int modChannels, bool pitchFmActive, bool isSynced, float secondsPerBeat) {
+        if (trackLoop && !(loopTracked && loopStartSamp == trackedLoopStart && loopEndSamp == trackedLoopEnd)) {
+            for (Grain& g : grains) {
+                g.setLoop(loopStartSamp, loopEndSamp);
+            }
+            trackedLoopStart = loopStartSamp;
+            trackedLoopEnd = loopEndSamp;
+        }
+        loopTracked = trackLoop;
+
+        int mask = (trackPitch ? 1 : 0) | (trackShape ? 2 : 0) | (trackSize ? 4 : 0);
+        if (!mask) {
+            trackedMask = 0;
+            return;
+        }
+
+        float pitchVolts[PORT_MAX_CHANNELS];
+        float shapeBase[PORT_MAX_CHANNELS];
+        float sizeBase[PORT_MAX_CHANNELS];
+        bool changed = mask != trackedMask || modChannels != trackedChannels || rateRatio != trackedRateRatio
+            || (trackSize && (isSynced != trackedSynced || secondsPerBeat != trackedSecondsPerBeat));
+        for (int c = 0; c < modChannels; c++) {
+            if (trackPitch) {
+                pitchVolts[c] = getPitchVolts(c, pitchFmActive);
+                changed |= pitchVolts[c] != trackedPitchVolts[c];
+            }
+            if (trackShape) {
+                shapeBase[c] = getShapeBase(c);
+                changed |= shapeBase[c] != trackedShapeBase[c];
+            }
+            if (trackSize) {
+                sizeBase[c] = getSizeBase(c);
+                changed |= sizeBase[c] != trackedSizeBase[c];
+            }
+        }
+        if (!changed) return;
+
+        trackedMask = mask;
+        trackedChannels = modChannels;
+        trackedSynced = isSynced;
+        trackedSecondsPerBeat = secondsPerBeat;
+        trackedRateRatio = rateRatio;
+        if (trackPitch) std::copy(pitchVolts, pitchVolts + modChannels, trackedPitchVolts);
+        if (trackShape) std::copy(shapeBase, shapeBase + modChannels, trackedShapeBase);
+        if (trackSize) std::copy(sizeBase, sizeBase + modChannels, trackedSizeBase);
+
+        float pitchRatio[PORT_MAX_CHANNELS];
+        if (trackPitch) {
+            for (int c = 0; c < modChannels; c++) pitchRatio[c] = dsp::exp2_taylor5(pitchVolts[c]) * rateRatio;
+        }
+
+        for (Grain& g : grains) {
+            if (g.formant) continue;
+            // Channel count may have dropped since the grain spawned
+            int c = g.modChannel < modChannels ? g.modChannel : 0;
+            if (trackPitch) {
+                g.playbackSpeedRatio = pitchRatio[c] * g.pitchRandomRatio;
+            }
+            if (trackShape) {
+                g.finalEnvShape = rack::math::clamp(shapeBase[c] + g.shapeDeviation, 0.f, 1.f);
+            }
+            if (trackSize) {
+                float size_0_to_1 = rack::math::clamp(sizeBase[c] + g.sizeDeviation, 0.f, 1.f);
+                g.lifeIncrement = getLifeIncrement(getGrainSizeSeconds(size_0_to_1, isSynced, secondsPerBeat));
+            }
+        }
+    }
+
+    // Scaled voltage of every channel at once, mono inputs feeding all of
+    // them, so grains can index by their own channel.
+    void readModChannels(Input& input, float scale, float* out) {
+        if (input.getChannels() <= 1) {
+            std::fill(out, out + PORT_MAX_CHANNELS, input.getVoltage() * scale);
+            return;
+        }
+        const float* v = input.getVoltages();
+        for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+            out[c] = v[c] * scale;
+        }
     }
 
     Granular() {
@@ -293,6 +1555,11 @@ struct Granular : Module {
 
         configParam(BPM_PARAM, 30.f, 300.f, 120.f, "BPM");
         configSwitch(SYNC_PARAM, 0.f, 1.f, 0.f, "Sync Mode", {"Free", "Synced"});
+        configSwitch(DIRECTION_PARAM, 0.f, 2.f, 0.f, "Grain Direction", {"Forward", "Reverse", "Ping-pong"});
+        configParam(R_DIRECTION_PARAM, 0.f, 1.f, 0.f, "Randomise Direction", "%", 0.f, 100.f);
+        configParam(SCAN_PARAM, -2.f, 2.f, 1.f, "Time-stretch Scan Rate", "x");
+        configButton(PREV_FILE_PARAM, "Previous File");
+        configButton(NEXT_FILE_PARAM, "Next File");
 
         configInput(_1VOCT_INPUT, "1V/Oct Pitch / Audio In");
         configInput(M_SIZE_INPUT, "Size Mod CV");
@@ -300,93 +1567,274 @@ struct Granular : Module {
         configInput(M_ENV_SHAPE_INPUT, "Shape Mod CV");
         configInput(M_POSITION_INPUT, "Position Mod CV");
         configInput(M_PITCH_INPUT, "Pitch Mod CV");
+        configInput(CLOCK_INPUT, "Clock");
+        configInput(RESET_INPUT, "Reset");
+        configInput(NEXT_FILE_INPUT, "Next File Trigger");
         configOutput(SINE_OUTPUT, "Audio Output");
 
-        grains.reserve(MAX_GRAINS);
+        grains.reserve(MAX_GRAINS + GrainScheduler::RELEASE_HEADROOM);
+        trackDivider.setDivision(TRACK_DIVISION);
+        formantDivider.setDivision(FORMANT_DIVISION);
+        snapshotDivider.setDivision(SNAPSHOT_DIVISION);
+
+        SampleLoadPool::get().addUpkeep(this, [this]() { upkeepRetiredSamples(); });
+    }
+
+    ~Granular() {
+        SampleLoadPool::get().cancelAll(this);
+    }
+
+    json_t* dataToJson() override {
+        json_t* rootJ = json_object();
+        std::shared_ptr<GranularSample> current = getPublishedSample();
+        // A recording made while browsing a folder is saved instead of it
+        if (!folderPath.empty() && !(current && current->rawVoltage)) {
+            json_object_set_new(rootJ, "folder", json_string(folderPath.c_str()));
+            json_object_set_new(rootJ, "folderIndex", json_integer(folderIndex));
+        }
+        else if (isLoading) {
+            if (loadingRecording) json_object_set_new(rootJ, "recording", json_boolean(true));
+            else if (!loadingPath.empty()) json_object_set_new(rootJ, "path", json_string(loadingPath.c_str()));
+        }
+        else if (current && !current->path.empty()) {
+            json_object_set_new(rootJ, "path", json_string(current->path.c_str()));
+        }
+        else if (current && current->rawVoltage && current->length > 0) {
+            json_object_set_new(rootJ, "recording", json_boolean(true));
+        }
+        json_object_set_new(rootJ, "grainBudget", json_integer(scheduler.budget));
+        json_object_set_new(rootJ, "stealPolicy", json_integer(scheduler.policy));
+        json_object_set_new(rootJ, "adaptiveDensity", json_boolean(scheduler.adaptive));
+        json_object_set_new(rootJ, "adaptiveTarget", json_real(scheduler.targetLoad));
+        json_object_set_new(rootJ, "planSpawnBlocks", json_boolean(scheduler.planBlocks));
+        json_object_set_new(rootJ, "clockPpqn", json_integer(clock.ppqn));
+        json_object_set_new(rootJ, "pitchFm", json_boolean(pitchFm));
+        json_object_set_new(rootJ, "positionFm", json_boolean(positionFm));
+        json_object_set_new(rootJ, "trackPitch", json_boolean(trackPitch));
+        json_object_set_new(rootJ, "trackShape", json_boolean(trackShape));
+        json_object_set_new(rootJ, "trackSize", json_boolean(trackSize));
+        json_object_set_new(rootJ, "trackLoop", json_boolean(trackLoop));
+        json_object_set_new(rootJ, "timeStretch", json_boolean(timeStretch));
+        json_object_set_new(rootJ, "preserveFormants", json_boolean(preserveFormants));
+        json_object_set_new(rootJ, "oversample", json_integer(saturator.oversample));
+        json_object_set_new(rootJ, "storageFormat", json_integer(storageFormat));
+        return rootJ;
+    }
+
+    void dataFromJson(json_t* rootJ) override {
+        // Before the sample, which is stored in this format
+        json_t* storageFormatJ = json_object_get(rootJ, "storageFormat");
+        if (storageFormatJ)
+            storageFormat = rack::math::clamp((int)json_integer_value(storageFormatJ), 0, GranularSample::NUM_FORMATS - 1);
+        json_t* recordingJ = json_object_get(rootJ, "recording");
+        json_t* pathJ = json_object_get(rootJ, "path");
+        json_t* folderJ = json_object_get(rootJ, "folder");
+        json_t* folderIndexJ = json_object_get(rootJ, "folderIndex");
+        if (folderJ && json_string_value(folderJ)) {
+            loadFolder(json_string_value(folderJ), folderIndexJ ? json_integer_value(folderIndexJ) : 0);
+        }
+        else if (recordingJ && json_boolean_value(recordingJ)) {
+            loadSampleAsync(system::join(getPatchStorageDirectory(), RECORDING_FILENAME), true);
+        }
+        else if (pathJ && json_string_value(pathJ)) {
+            loadSampleAsync(json_string_value(pathJ), false);
+        }
+
+        json_t* budgetJ = json_object_get(rootJ, "grainBudget");
+        if (budgetJ)
+            scheduler.budget = rack::math::clamp((int)json_integer_value(budgetJ), 1, MAX_GRAINS);
+        json_t* policyJ = json_object_get(rootJ, "stealPolicy");
+        if (policyJ)
+            scheduler.policy = rack::math::clamp((int)json_integer_value(policyJ), 0, GrainScheduler::NUM_STEAL_POLICIES - 1);
+        json_t* adaptiveJ = json_object_get(rootJ, "adaptiveDensity");
+        if (adaptiveJ)
+            scheduler.adaptive = json_boolean_value(adaptiveJ);
+        json_t* targetJ = json_object_get(rootJ, "adaptiveTarget");
+        if (targetJ)
+            scheduler.targetLoad = rack::math::clamp((float)json_number_value(targetJ), 0.01f, 1.f);
+        json_t* planBlocksJ = json_object_get(rootJ, "planSpawnBlocks");
+        if (planBlocksJ)
+            scheduler.planBlocks = json_boolean_value(planBlocksJ);
+        json_t* ppqnJ = json_object_get(rootJ, "clockPpqn");
+        if (ppqnJ)
+            clock.ppqn = rack::math::clamp((int)json_integer_value(ppqnJ), 1, 96);
+        json_t* pitchFmJ = json_object_get(rootJ, "pitchFm");
+        if (pitchFmJ)
+            pitchFm = json_boolean_value(pitchFmJ);
+        json_t* positionFmJ = json_object_get(rootJ, "positionFm");
+        if (positionFmJ)
+            positionFm = json_boolean_value(positionFmJ);
+        json_t* trackPitchJ = json_object_get(rootJ, "trackPitch");
+        if (trackPitchJ)
+            trackPitch = json_boolean_value(trackPitchJ);
+        json_t* trackShapeJ = json_object_get(rootJ, "trackShape");
+        if (trackShapeJ)
+            trackShape = json_boolean_value(trackShapeJ);
+        json_t* trackSizeJ = json_object_get(rootJ, "trackSize");
+        if (trackSizeJ)
+            trackSize = json_boolean_value(trackSizeJ);
+        json_t* trackLoopJ = json_object_get(rootJ, "trackLoop");
+        if (trackLoopJ)
+            trackLoop = json_boolean_value(trackLoopJ);
+        json_t* timeStretchJ = json_object_get(rootJ, "timeStretch");
+        if (timeStretchJ)
+            timeStretch = json_boolean_value(timeStretchJ);
+        json_t* preserveFormantsJ = json_object_get(rootJ, "preserveFormants");
+        if (preserveFormantsJ)
+            preserveFormants = json_boolean_value(preserveFormantsJ);
+
+        json_t* oversampleJ = json_object_get(rootJ, "oversample");
+        if (oversampleJ) {
+            int factor = json_integer_value(oversampleJ);
+            for (int i = 0; i < NUM_OVERSAMPLE_FACTORS; i++) {
+                if (OVERSAMPLE_FACTORS[i] == factor) saturator.oversample = factor;
+            }
+        }
     }
 
     void process(const ProcessArgs& args) override {
+        PROFILE_TICK(args.sampleRate);
+        if (getRetireSpace() >= 1 && samplePending.exchange(false)) {
+            std::shared_ptr<GranularSample> next = std::atomic_exchange(&pendingSample, std::shared_ptr<GranularSample>());
+            // A cancelled load, or a folder file decoded for a position
+            // stepped away from since
+            if (next && (next->generation != sampleGeneration || (next->folderIndex >= 0 && next->folderIndex != folderIndex))) {
+                retireSample(std::move(next));
+            }
+            else {
+                adoptSample(std::move(next));
+            }
+        }
         lights[BLINK_LIGHT].setBrightness(isLoading);
 
+        bool prevFile = prevFileTrigger.process(params[PREV_FILE_PARAM].getValue());
+        bool nextFile = nextFileTrigger.process(params[NEXT_FILE_PARAM].getValue());
+        nextFile |= nextFileCvTrigger.process(inputs[NEXT_FILE_INPUT].getVoltage(), 0.1f, 2.f);
+        if (prevFile != nextFile) {
+            queuedFolderSteps += nextFile ? 1 : -1;
+        }
+        // One step per sample, and only with room to retire both the
+        // current file and a stale staged one
+        if (queuedFolderSteps != 0 && getRetireSpace() >= 2) {
+            int direction = queuedFolderSteps > 0 ? 1 : -1;
+            queuedFolderSteps -= direction;
+            stepFolder(direction);
+        }
+
         bool recActive = params[LIVE_REC_PARAM].getValue() > 0.5f;
         lights[LIVE_REC_LIGHT].setBrightness(recActive ? 1.f : 0.f);
 
-        // --- TRIGGER RECORD START ---
-        if (recTrigger.process(recActive ? 10.f : 0.f)) {
-            isLoading = true;
+        // Tracked even while recording so the tempo is ready on playback
+        bool clockConnected = inputs[CLOCK_INPUT].isConnected();
+        bool resetEdge = clock.process(clockConnected ? inputs[CLOCK_INPUT].getVoltage() : 0.f, inputs[RESET_INPUT].getVoltage(), args.sampleRate);
+        bool clockLocked = clockConnected && clock.isLocked();
 
-            if (audioBuffer.size() < 44100) {
-                audioBuffer.resize(args.sampleRate * 10.0f);
-                fileSampleRate = args.sampleRate;
+        // --- TRIGGER RECORD START ---
+        // Held off while the retire ring is full; the trigger fires once
+        // there is room since the button is still down
+        if (getRetireSpace() >= 2 && recTrigger.process(recActive ? 10.f : 0.f)) {
+            size_t capacity = (size_t)(args.sampleRate * 10.0f);
+            GranularSample::Format format = (GranularSample::Format)storageFormat.load();
+            if (!recordSample || recordSample->capacity != capacity || recordSample->format != format) {
+                // Allocates on the audio thread, but only on the first
+                // recording or after a sample rate or storage change
+                retireSample(std::move(recordSample));
+                recordSample = std::make_shared<GranularSample>(capacity, (unsigned int)args.sampleRate, true, format, RECORDING_FULL_SCALE);
             }
-
-            std::fill(audioBuffer.begin(), audioBuffer.end(), 0.f);
-            bufferIsRawVoltage = true;
+            else {
+                recordingStarts++;
+                recordSample->clear();
+            }
+            recordSample->length = capacity;
+            adoptSample(recordSample);
             recHead = 0;
             bufferWrapped = false;
-            isLoading = false;
         }
 
         // --- HANDLE RECORD STOP ---
-        if (wasRecordingPrev && !recActive) {
+        if (wasRecordingPrev && !recActive && sample && sample == recordSample) {
             if (bufferWrapped) {
-                activeBufferLen = audioBuffer.size();
+                activeBufferLen = getBufferCapacity();
             } else {
-                activeBufferLen = (recHead > 100) ? recHead : 44100;
+                activeBufferLen = std::min((recHead > 100) ? recHead : (size_t)44100, getBufferCapacity());
             }
+            sample->length = activeBufferLen;
+            recordingDirty = true;
         }
         wasRecordingPrev = recActive;
         isRecording = recActive;
 
         if (isRecording) {
-            if (!audioBuffer.empty()) {
+            PROFILE_BEGIN(STAGE_RECORD);
+            // A file dropped mid-recording replaces the record buffer; never
+            // write into it
+            if (sample && sample == recordSample) {
                 float in = inputs[_1VOCT_INPUT].getVoltage();
-                if (recHead < audioBuffer.size()) {
-                    audioBuffer[recHead] = in;
+                size_t capacity = getBufferCapacity();
+                if (recHead < capacity) {
+                    sample->set(recHead, in);
                 }
                 recHead++;
-                if (recHead >= audioBuffer.size()) {
+                if (recHead >= capacity) {
                     recHead = 0;
                     bufferWrapped = true;
                 }
-                activeBufferLen = audioBuffer.size();
+                activeBufferLen = capacity;
             }
             outputs[SINE_OUTPUT].setVoltage(0.f);
+            PROFILE_END(STAGE_RECORD);
             return;
         }
 
-        if (isLoading || audioBuffer.empty() || activeBufferLen == 0) {
+        if (isLoading || !sample || activeBufferLen < 2) {
             outputs[SINE_OUTPUT].setVoltage(0.f);
             return;
         }
 
         // --- STANDARD PLAYBACK ---
 
+        engineSampleRate = args.sampleRate;
+        rateRatio = (double)fileSampleRate / args.sampleRate;
+
         float startVal = params[START_PARAM].getValue();
         float endVal = params[END_PARAM].getValue();
         float loopStartNorm = std::min(startVal, endVal);
         float loopEndNorm = std::max(startVal, endVal);
 
-        double loopStartSamp = loopStartNorm * (double)(activeBufferLen - 1);
-        double loopEndSamp = loopEndNorm * (double)(activeBufferLen - 1);
+        // Whole-sample bounds so the second tap wraps exactly at the loop end
+        size_t loopStartIdx = (size_t)(loopStartNorm * (activeBufferLen - 1));
+        size_t loopEndIdx = std::max<size_t>((size_t)(loopEndNorm * (activeBufferLen - 1)), 1);
+        if (loopStartIdx >= loopEndIdx) loopStartIdx = loopEndIdx - 1;
 
-        if (loopEndSamp >= activeBufferLen) loopEndSamp = activeBufferLen - 1;
-        if (loopStartSamp < 0) loopStartSamp = 0;
-        if (loopStartSamp >= loopEndSamp) loopStartSamp = loopEndSamp - 1;
+        double loopStartSamp = (double)loopStartIdx;
+        double loopEndSamp = (double)loopEndIdx;
 
         // --- SYNC & BPM LOGIC START ---
 
         bool isSynced = params[SYNC_PARAM].getValue() > 0.5f;
-        float currentBPM = params[BPM_PARAM].getValue();
+        // A locked external clock replaces the BPM knob
+        float currentBPM = clockLocked ? clock.getBpm(args.sampleRate) : params[BPM_PARAM].getValue();
         float secondsPerBeat = 60.f / currentBPM;
 
+        // --- POLYPHONIC MODULATION ---
+        // Spawn-time modulation reads the channel the next grain will take
+        int modChannels = 1;
+        for (int i = M_SIZE_INPUT; i <= M_PITCH_INPUT; i++) {
+            modChannels = std::max(modChannels, inputs[i].getChannels());
+        }
+        int spawnChannel = nextModChannel % modChannels;
+
+        bool pitchFmActive = pitchFm && inputs[M_PITCH_INPUT].isConnected();
+        bool positionFmActive = positionFm && inputs[M_POSITION_INPUT].isConnected();
+
         // 1. DENSITY CALCULATION
         float density_hz_final = 10.f;
+        float densityDivision = 0.f;
 
         float density_raw = params[DENSITY_PARAM].getValue();
         float density_norm = rack::math::rescale(density_raw, 1.f, 100.f, 0.f, 1.f);
         float density_mod_amount = params[M_DENSITY_PARAM].getValue();
-        density_norm += inputs[M_DENSITY_INPUT].getVoltage() * density_mod_amount * 0.1f;
+        density_norm += inputs[M_DENSITY_INPUT].getPolyVoltage(spawnChannel) * density_mod_amount * 0.1f;
 
         float density_base_0_to_1 = rack::math::clamp(density_norm, 0.f, 1.f);
         float r_density_knob = params[R_DENSITY_PARAM].getValue();
@@ -401,6 +1849,7 @@ struct Granular : Module {
             index = rack::math::clamp(index, 0, NUM_SYNC_DIVS - 1);
 
             float divMultiplier = SYNC_DIVISIONS[index];
+            densityDivision = divMultiplier;
             float period = secondsPerBeat * divMultiplier;
             if (period < 0.0001f) period = 0.0001f;
             density_hz_final = 1.f / period;
@@ -410,122 +1859,602 @@ struct Granular : Module {
         }
 
         // 2. SIZE CALCULATION
-        float grainSize_sec_final = 0.1f;
-
-        float size_raw = params[SIZE_PARAM].getValue();
-        float size_norm = rack::math::rescale(size_raw, 0.01f, 2.0f, 0.f, 1.f);
-        float size_mod_amount = params[M_SIZE_PARAM].getValue();
-        size_norm += inputs[M_SIZE_INPUT].getVoltage() * size_mod_amount * 0.1f;
-
-        float size_base_0_to_1 = rack::math::clamp(size_norm, 0.f, 1.f);
+        // Randomised per grain at spawn
+        float size_base_0_to_1 = getSizeBase(spawnChannel);
         float r_size_knob = params[R_SIZE_PARAM].getValue();
-        float size_rand_0_to_1 = getClampedRandomizedValue(size_base_0_to_1, r_size_knob);
-
-        if (isSynced) {
-            int index = (int)(size_rand_0_to_1 * (NUM_SYNC_DIVS - 1) + 0.5f);
-            index = rack::math::clamp(index, 0, NUM_SYNC_DIVS - 1);
-
-            float divMultiplier = SYNC_DIVISIONS[index];
-            grainSize_sec_final = secondsPerBeat * divMultiplier;
-        } else {
-             grainSize_sec_final = rack::math::rescale(size_rand_0_to_1, 0.f, 1.f, 0.01f, 2.0f);
-        }
 
         // --- OTHER PARAMS ---
 
-        float envShape_base = params[ENV_SHAPE_PARAM].getValue();
-        float shape_mod_amount = params[M_AMOUNT_ENV_SHAPE_PARAM].getValue();
-        envShape_base += inputs[M_ENV_SHAPE_INPUT].getVoltage() * shape_mod_amount * 0.1f;
-        envShape_base = rack::math::clamp(envShape_base, 0.f, 1.f);
+        float envShape_base = getShapeBase(spawnChannel);
 
+        // In FM mode the position and pitch inputs act on every live grain
+        // below instead of being latched at spawn.
         grainSpawnPosition = params[POSITION_PARAM].getValue();
         float pos_mod_amount = params[M_AMOUNT_POSITION_PARAM].getValue();
-        grainSpawnPosition += inputs[M_POSITION_INPUT].getVoltage() * pos_mod_amount * 0.1f;
+        if (!positionFmActive) {
+            grainSpawnPosition += inputs[M_POSITION_INPUT].getPolyVoltage(spawnChannel) * pos_mod_amount * 0.1f;
+        }
         grainSpawnPosition = rack::math::clamp(grainSpawnPosition, 0.f, 1.f);
 
-        float pitchKnob = params[PITCH_PARAM].getValue();
+        if (timeStretch) {
+            // Scan through the loop; a rate of 0 freezes on the current spot
+            double loopWidth = loopEndSamp - loopStartSamp;
+            scanOffset += params[SCAN_PARAM].getValue() * rateRatio;
+            if (resetEdge) scanOffset = 0.0;
+            if (scanOffset >= loopWidth) scanOffset -= loopWidth;
+            else if (scanOffset < 0.0) scanOffset += loopWidth;
+            if (scanOffset >= loopWidth || scanOffset < 0.0) {
+                scanOffset -= loopWidth * std::floor(scanOffset / loopWidth);
+            }
+
+            double scanPos = grainSpawnPosition * (double)(activeBufferLen - 1) - loopStartSamp + scanOffset;
+            scanPos -= loopWidth * std::floor(scanPos / loopWidth);
+            grainSpawnPosition = (float)((loopStartSamp + scanPos) / (activeBufferLen - 1));
+        }
+
+        float basePitchVolts = getPitchVolts(spawnChannel, pitchFmActive);
         float pitch_mod_amount = params[M_AMOUNT_PITCH_PARAM].getValue();
-        pitchKnob += inputs[M_PITCH_INPUT].getVoltage() * pitch_mod_amount * 0.1f;
-        pitchKnob = rack::math::clamp(pitchKnob, 0.f, 1.f);
 
-        float pitchOffsetOctaves = (pitchKnob - 0.5f) * 4.f;
-        float basePitchVolts = pitchOffsetOctaves;
+        // Pitch-synchronous spawning: one grain per target pitch period
+        if (preserveFormants) {
+            // The last estimate holds until the running one finishes
+            if (formantDivider.process() && !pitchTracker.isBusy()) {
+                size_t periodPos = (size_t)(grainSpawnPosition * (activeBufferLen - 1));
+                bool started = sample->visit([&](const auto* buffer) {
+                    return pitchTracker.begin(buffer, activeBufferLen, periodPos, fileSampleRate, sample->scale);
+                });
+                if (!started) formantPeriod = 0.f;
+            }
+            if (pitchTracker.isBusy()) {
+                sample->visit([&](const auto* buffer) { pitchTracker.step(buffer, formantPeriod); });
+            }
+        }
+        else {
+            formantPeriod = 0.f;
+            pitchTracker.reset();
+        }
+        bool formantActive = formantPeriod > 0.f;
+        if (formantActive) {
+            density_hz_final = std::pow(2.f, basePitchVolts) * fileSampleRate / formantPeriod;
+        }
 
         float r_envShape_knob = params[R_ENV_SHAPE_PARAM].getValue();
         float r_position_knob = params[R_POSITION_PARAM].getValue();
         float r_pitch_knob = params[R_PITCH_PARAM].getValue();
+        int directionMode = (int)params[DIRECTION_PARAM].getValue();
+        float r_direction_knob = params[R_DIRECTION_PARAM].getValue();
 
         float compression_amount = params[COMPRESSION_PARAM].getValue();
 
         // --- SPAWNING ---
 
-        grainSpawnTimer -= args.sampleTime;
-        if (grainSpawnTimer <= 0.f) {
-            // Use Calculated Frequency
-            grainSpawnTimer = 1.f / density_hz_final;
+        PROFILE_BEGIN(STAGE_SPAWN);
+        // Onsets due by the end of this sample, as samples late. Each grain
+        // starts part-way into its first sample by that much, so onsets land
+        // between samples instead of being rounded up.
+        float onsets[MAX_SPAWNS_PER_SAMPLE];
+        int numOnsets = 0;
+        if (isSynced && clockLocked && !formantActive) {
+            scheduler.leaveBlock(grainSpawnTimer, args.sampleTime);
+            // Follow the tracked beat phase rather than a free-running timer
+            float lateSamples;
+            if (resetEdge) scheduler.restartClocked();
+            if (clock.crossedDivision(densityDivision, lateSamples) && scheduler.keepClockedOnset()) {
+                onsets[numOnsets++] = lateSamples;
+            }
+        }
+        else if (scheduler.planBlocks) {
+            if (resetEdge) {
+                // Restart the train with an onset on this sample
+                grainSpawnTimer = args.sampleTime;
+                scheduler.planPosition = 0;
+            }
+            if (scheduler.planPosition == 0) {
+                scheduler.planBlock(grainSpawnTimer, 1.0 / (density_hz_final * scheduler.densityScale), args.sampleRate);
+            }
+            numOnsets = scheduler.takeDue(onsets, MAX_SPAWNS_PER_SAMPLE);
+        }
+        else {
+            scheduler.leaveBlock(grainSpawnTimer, args.sampleTime);
+            // Held while the clock drives spawning, so losing the lock
+            // resumes the train instead of bursting to catch up
+            grainSpawnTimer -= args.sampleTime;
+            if (resetEdge) grainSpawnTimer = 0.0;
+            while (grainSpawnTimer <= 0.0) {
+                if (numOnsets == MAX_SPAWNS_PER_SAMPLE) {
+                    // Far behind (e.g. density jumped up), restart the train
+                    grainSpawnTimer = 0.0;
+                    break;
+                }
+                onsets[numOnsets++] = (float)(-grainSpawnTimer * args.sampleRate);
+
+                // Use Calculated Frequency
+                grainSpawnTimer += 1.0 / (density_hz_final * scheduler.densityScale);
+            }
+            // A density increase takes effect now rather than after the
+            // pending long period
+            grainSpawnTimer = std::min(grainSpawnTimer, 1.0 / (density_hz_final * scheduler.densityScale));
+        }
 
-            if (grains.size() < MAX_GRAINS) {
+        for (int n = 0; n < numOnsets; n++) {
+            float lateSamples = onsets[n];
+            if (scheduler.admit(grains, MAX_GRAINS + GrainScheduler::RELEASE_HEADROOM, args.sampleRate)) {
                 Grain g;
                 float position_final_norm = getClampedRandomizedValue(grainSpawnPosition, r_position_knob);
                 if (position_final_norm < loopStartNorm) position_final_norm = loopStartNorm;
                 if (position_final_norm > loopEndNorm) position_final_norm = loopEndNorm;
 
-                g.bufferPos = position_final_norm * (activeBufferLen - 1);
+                double spawnPos = position_final_norm * (activeBufferLen - 1);
 
                 float maxRandomOctaves = r_pitch_knob * 1.f;
                 float randomOctaveOffset = (rack::random::uniform() * 2.f - 1.f) * maxRandomOctaves;
 
-                float totalPitchVolts = basePitchVolts + randomOctaveOffset;
-                g.playbackSpeedRatio = std::pow(2.f, totalPitchVolts);
+                g.pitchRandomRatio = std::pow(2.f, randomOctaveOffset);
+                g.playbackSpeedRatio = std::pow(2.f, basePitchVolts) * g.pitchRandomRatio * rateRatio;
+
+                g.sizeDeviation = getRandomDeviation(r_size_knob);
+                float size_0_to_1 = rack::math::clamp(size_base_0_to_1 + g.sizeDeviation, 0.f, 1.f);
+                g.lifeIncrement = getLifeIncrement(getGrainSizeSeconds(size_0_to_1, isSynced, secondsPerBeat));
 
-                // Use Calculated Size
-                float grainSize_sec = grainSize_sec_final;
+                g.shapeDeviation = getRandomDeviation(r_envShape_knob);
+                g.finalEnvShape = rack::math::clamp(envShape_base + g.shapeDeviation, 0.f, 1.f);
 
-                g.finalEnvShape = getClampedRandomizedValue(envShape_base, r_envShape_knob);
-                g.life = 0.f;
-                float grainSizeInSamples = grainSize_sec * fileSampleRate;
-                if (grainSizeInSamples < 1.f) grainSizeInSamples = 1.f;
-                g.lifeIncrement = 1.f / grainSizeInSamples;
+                // Randomise flips the selected direction with that probability
+                g.direction = directionMode == DIRECTION_REVERSE ? -1.f : 1.f;
+                if (r_direction_knob > 0.f && rack::random::uniform() < r_direction_knob) {
+                    g.direction = -g.direction;
+                }
+                g.pingPong = directionMode == DIRECTION_PING_PONG;
+                g.bufferPos = loopStartSamp;
+                g.setLoop(loopStartSamp, loopEndSamp);
+
+                g.birth = scheduler.nextBirth++;
+                g.modChannel = spawnChannel;
+
+                if (formantActive) {
+                    // Source speed keeps the formants; the pitch comes from
+                    // the spawn rate. Two-period Hann grains overlap-add flat.
+                    g.formant = true;
+                    g.playbackSpeedRatio = rateRatio;
+                    g.lifeIncrement = (float)rateRatio / (2.f * formantPeriod);
+                    g.finalEnvShape = 1.f;
+                }
+
+                // Sub-sample onset offset
+                g.setPosition(rack::math::clamp(spawnPos + lateSamples * g.playbackSpeedRatio * g.direction, loopStartSamp, loopEndSamp));
+                g.life = lateSamples * g.lifeIncrement;
 
                 grains.push_back(g);
+                // Values that moved and came back between two tracking
+                // passes would otherwise leave this grain behind
+                if (loopStartSamp != trackedLoopStart || loopEndSamp != trackedLoopEnd) loopTracked = false;
+                if ((trackPitch && basePitchVolts != trackedPitchVolts[spawnChannel])
+                    || (trackShape && envShape_base != trackedShapeBase[spawnChannel])
+                    || (trackSize && size_base_0_to_1 != trackedSizeBase[spawnChannel])) {
+                    trackedMask = 0;
+                }
+                PROFILE_SPAWN();
+            }
+            else {
+                PROFILE_DROP();
             }
         }
+        if (numOnsets > 0) {
+            nextModChannel = (spawnChannel + 1) % modChannels;
+        }
+        PROFILE_END(STAGE_SPAWN);
 
-        float out = 0.f;
-        for (size_t i = 0; i < grains.size(); ++i) {
-            Grain& g = grains[i];
-            float sample = g.getSample(audioBuffer, activeBufferLen);
-            float env = g.getEnvelope(g.finalEnvShape);
-            out += sample * env;
-            g.advance(loopStartSamp, loopEndSamp);
+        if (trackDivider.process()) {
+            updateTrackedGrains(loopStartSamp, loopEndSamp, modChannels, pitchFmActive, isSynced, secondsPerBeat);
+        }
+        if (snapshotDivider.process()) {
+            publishGrainSnapshot();
         }
 
+        PROFILE_BEGIN(STAGE_RENDER);
+        int64_t renderStart = scheduler.adaptive ? GrainScheduler::now() : 0;
+
+        // Audio-rate FM, converted once per channel rather than per grain.
+        // Pitch keeps the spawn-time scaling of 0.4 octaves per volt at full
+        // amount; position moves the read head by up to the whole buffer.
+        if (pitchFmActive) {
+            readModChannels(inputs[M_PITCH_INPUT], pitch_mod_amount * 0.4f, pitchFmRatio);
+            for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+                pitchFmRatio[c] = dsp::exp2_taylor5(pitchFmRatio[c]);
+            }
+        }
+        if (positionFmActive) {
+            readModChannels(inputs[M_POSITION_INPUT], pos_mod_amount * 0.1f * (activeBufferLen - 1), positionFmOffset);
+        }
+
+        // The int16 scale is linear, so it is applied once to the mix
+        float out = sample->visit([&](const auto* buffer) {
+            return renderGrains(buffer, positionFmActive, pitchFmActive);
+        }) * sample->scale;
+
         for (int i = grains.size() - 1; i >= 0; i--) {
             if (!grains[i].isAlive()) {
                 grains.erase(grains.begin() + i);
             }
         }
 
-        if (!grains.empty()) {
-            out /= std::sqrt(grains.size());
+        if (scheduler.adaptive) {
+            scheduler.addRenderTime(GrainScheduler::now() - renderStart, args.sampleRate);
+        }
+        else if (scheduler.densityScale != 1.f) {
+            scheduler.resetAdaptive();
         }
+        PROFILE_END(STAGE_RENDER);
 
-        float makeupGain = 1.0f + (compression_amount * 3.0f);
-        out *= makeupGain;
-        out = 5.0f * std::tanh(out);
+        PROFILE_BEGIN(STAGE_SATURATE);
+        out = normalizer.process(out, grains.size(), args.sampleRate);
+        out = dynamics.process(out, compression_amount, args.sampleRate);
+        out = 5.0f * saturator.process(out);
+        PROFILE_END(STAGE_SATURATE);
 
         outputs[SINE_OUTPUT].setVoltage(out);
     }
 
 
-    void setBuffer(std::vector<float> newBuffer, unsigned int newSampleRate) {
-        audioBuffer = newBuffer;
-        activeBufferLen = audioBuffer.size();
-        fileSampleRate = newSampleRate;
+    template <typename T>
+    float renderGrains(const T* buffer, bool positionFmActive, bool pitchFmActive) {
+        float out = 0.f;
+        for (size_t i = 0; i < grains.size(); ++i) {
+            Grain& g = grains[i];
+            float sample = positionFmActive ? g.getSample(buffer, activeBufferLen, positionFmOffset[g.modChannel]) : g.getSample(buffer);
+            float env = g.getEnvelope(g.finalEnvShape);
+            out += sample * env * g.fadeGain;
+            g.advance(pitchFmActive ? pitchFmRatio[g.modChannel] : 1.f);
+        }
+        return out;
+    }
+
+    // UI or loader thread. Queues a sample for the engine, which picks it
+    // up at the start of its next sample.
+    void queueSample(std::shared_ptr<GranularSample> newSample) {
+        std::atomic_store(&pendingSample, newSample);
+        samplePending = true;
+    }
+
+    // Any thread. Streams a file into a new sample in the current storage
+    // format, one chunk at a time, so a long file never exists as a full
+    // float copy next to its storage. Saved recordings are scaled back to
+    // voltages and keep no path, so they are saved with the patch again.
+    // Returns NULL early once `cancelled` is set.
+    std::shared_ptr<GranularSample> decodeSample(const std::string& path, bool recording, const std::atomic<bool>* cancelled = nullptr) {
+        std::unique_ptr<SampleDecoder> decoder = SampleDecoder::open(path);
+        if (!decoder || decoder->length == 0) return nullptr;
+
+        std::shared_ptr<GranularSample> newSample = std::make_shared<GranularSample>(decoder->length, decoder->sampleRate, recording,
+            (GranularSample::Format)storageFormat.load(), recording ? RECORDING_FULL_SCALE : 1.f);
+        float gain = (recording ? RECORDING_FULL_SCALE : 1.f) / newSample->scale;
+        const size_t CHUNK = 4096;
+        float chunk[CHUNK];
+        size_t length = 0;
+        while (length < newSample->capacity) {
+            if (cancelled && *cancelled) return nullptr;
+            size_t n = std::min(CHUNK, newSample->capacity - length);
+            // Float files decode in place
+            if (newSample->format == GranularSample::FORMAT_FLOAT && gain == 1.f) {
+                n = decoder->read(newSample->data.data() + length, n);
+            }
+            else {
+                n = decoder->read(chunk, n);
+                newSample->visit([&](auto* buffer) {
+                    for (size_t i = 0; i < n; i++) storeSample(buffer[length + i], chunk[i] * gain);
+                });
+            }
+            if (n == 0) break;
+            length += n;
+        }
+        if (length == 0) return nullptr;
+
+        newSample->length = length;
+        if (!recording) newSample->path = path;
+        return newSample;
+    }
+
+    // Patch open and file drops. Outputs silence with the load light on
+    // until the decode queued on the pool is done.
+    void loadSampleAsync(const std::string& path, bool recording) {
+        cancelLoad();
+        loadingPath = path;
+        loadingRecording = recording;
+        isLoading = true;
+        uint32_t generation = ++sampleGeneration;
+        loadJob = SampleLoadPool::get().submit(this, [this, path, recording, generation](const SampleLoadPool::Job& job) {
+            std::shared_ptr<GranularSample> newSample = decodeSample(path, recording, &job.cancelled);
+            // Superseded while decoding
+            if (job.cancelled || generation != sampleGeneration) return;
+            if (!newSample) {
+                isLoading = false;
+                return;
+            }
+            newSample->generation = generation;
+            queueSample(newSample);
+        });
+    }
+
+    // UI thread. Drops a queued load and stops a running one without
+    // waiting for it; anything it still produces is stale and the engine
+    // drops it.
+    void cancelLoad() {
+        SampleLoadPool::get().cancel(loadJob);
+        loadJob.reset();
+    }
+
+    // UI thread, every frame. Only matters while the job is still queued.
+    void updateLoadPriority(bool visible) {
+        if (!loadJob) return;
+        int priority = 0;
+        if (outputs[SINE_OUTPUT].isConnected()) priority += LOAD_PRIORITY_CONNECTED;
+        if (visible) priority += LOAD_PRIORITY_VISIBLE;
+        loadJob->priority = priority;
+    }
+
+    // Engine thread. Moves through the folder, wrapping at either end.
+    void stepFolder(int direction) {
+        int count = folderCount;
+        int index = folderIndex;
+        if (count < 2 || index < 0) return;
+        int target = (index + direction + count) % count;
+        folderIndex = target;
+        // Taken out of the slot, so a stale one is retired rather than
+        // released here
+        std::shared_ptr<GranularSample> staged = std::atomic_exchange(&stagedSamples[direction > 0 ? STAGED_NEXT : STAGED_PREV], std::shared_ptr<GranularSample>());
+        if (staged && staged->folderIndex == target && staged->generation == sampleGeneration) {
+            adoptSample(std::move(staged));
+        }
+        else {
+            retireSample(std::move(staged));
+        }
+    }
+
+    // UI thread. Lists the supported files in a directory and starts
+    // browsing it at `index`. Returns false if it holds none, leaving any
+    // load in progress to finish.
+    bool loadFolder(const std::string& path, int index) {
+        std::vector<std::string> files;
+        for (const std::string& entry : system::getEntries(path)) {
+            if (isSupportedSampleFile(entry)) files.push_back(entry);
+        }
+        if (files.empty()) return false;
+        std::sort(files.begin(), files.end());
+
+        cancelLoad();
+        clearFolder();
+        ++sampleGeneration;
+        folderPath = path;
+        folderFiles = std::move(files);
+        folderCount = folderFiles.size();
+        folderIndex = rack::math::clamp(index, 0, (int)folderFiles.size() - 1);
+        isLoading = true;
+        updateFolder();
+        return true;
+    }
+
+    // UI thread. Leaves folder mode, e.g. when a single file is dropped.
+    void clearFolder() {
+        SampleLoadPool::get().cancel(prefetchJob);
+        prefetchJob.reset();
+        prefetchCenter = -1;
+        folderIndex = -1;
+        folderCount = 0;
+        folderPath.clear();
+        folderFiles.clear();
+        for (int i = 0; i < NUM_STAGED; i++) {
+            std::atomic_store(&stagedSamples[i], std::shared_ptr<GranularSample>());
+        }
+    }
+
+    // UI thread. Decodes the current folder file and its neighbours again,
+    // in the storage format selected since. The old file keeps playing
+    // until its replacement is ready.
+    void reloadFolder() {
+        SampleLoadPool::get().cancel(prefetchJob);
+        prefetchJob.reset();
+        // Makes every decoded entry stale, so the current file is queued
+        // again and nothing in the old format is restaged
+        ++sampleGeneration;
+        for (int i = 0; i < NUM_STAGED; i++) {
+            std::atomic_store(&stagedSamples[i], std::shared_ptr<GranularSample>());
+        }
+        prefetchCenter = -1;
+        updateFolder();
+    }
+
+    // UI thread, every frame. Once the engine has stepped, restages the
+    // new neighbours, reusing samples already decoded and queueing the
+    // rest on the pool. One job runs at a time; a step made while it runs
+    // is planned for when it finishes.
+    void updateFolder() {
+        int center = folderIndex;
+        if (center < 0 || center == prefetchCenter || (prefetchJob && !prefetchJob->isFinished())) return;
+        prefetchCenter = center;
+
+        int count = folderFiles.size();
+        // The file stepped away from is retired, and becomes a neighbour
+        std::vector<std::shared_ptr<GranularSample>> known = {
+            getPublishedSample(),
+            std::atomic_load(&stagedSamples[STAGED_PREV]),
+            std::atomic_load(&stagedSamples[STAGED_NEXT]),
+        };
+        {
+            std::lock_guard<std::mutex> lock(retireMutex);
+            for (uint32_t read = retireRead; read != retireWrite; read++) {
+                known.push_back(retiredSamples[read % RETIRE_SLOTS]);
+            }
+        }
+        // Matched on the generation too, so the same index in a folder
+        // dropped before does not count
+        uint32_t generation = sampleGeneration;
+        auto isEntry = [&](const std::shared_ptr<GranularSample>& s, int index) {
+            return s && s->folderIndex == index && s->generation == generation;
+        };
+        auto findKnown = [&](int index) {
+            for (const std::shared_ptr<GranularSample>& s : known) {
+                if (isEntry(s, index)) return s;
+            }
+            return std::shared_ptr<GranularSample>();
+        };
+
+        // Files to decode, the current one first if a step outran the
+        // staging. With two files both neighbours are the same one.
+        struct Wanted {
+            int index;
+            bool play;
+            bool staged[NUM_STAGED];
+        };
+        std::vector<Wanted> wanted;
+        auto want = [&](int index) -> Wanted& {
+            for (Wanted& w : wanted) {
+                if (w.index == index) return w;
+            }
+            wanted.push_back({index, false, {false, false}});
+            return wanted.back();
+        };
+
+        if (!isEntry(known[0], center)) {
+            std::shared_ptr<GranularSample> s = findKnown(center);
+            if (s) queueSample(s);
+            else want(center).play = true;
+        }
+        if (count > 1) {
+            int neighbours[NUM_STAGED];
+            neighbours[STAGED_PREV] = (center + count - 1) % count;
+            neighbours[STAGED_NEXT] = (center + 1) % count;
+            for (int slot : {STAGED_NEXT, STAGED_PREV}) {
+                std::shared_ptr<GranularSample> s = findKnown(neighbours[slot]);
+                std::atomic_store(&stagedSamples[slot], s);
+                if (!s) want(neighbours[slot]).staged[slot] = true;
+            }
+        }
+
+        if (wanted.empty()) return;
+        std::vector<std::string> paths;
+        for (const Wanted& w : wanted) paths.push_back(folderFiles[w.index]);
+
+        prefetchJob = SampleLoadPool::get().submit(this, [this, center, generation, wanted, paths](const SampleLoadPool::Job& job) {
+            for (size_t i = 0; i < wanted.size(); i++) {
+                // Stepped on meanwhile; the UI plans again around the new file
+                if (job.cancelled || folderIndex != center) break;
+                std::shared_ptr<GranularSample> decoded = decodeSample(paths[i], false, &job.cancelled);
+                if (job.cancelled) break;
+                if (!decoded) {
+                    if (wanted[i].play && generation == sampleGeneration) isLoading = false;
+                    continue;
+                }
+                decoded->folderIndex = wanted[i].index;
+                decoded->generation = generation;
+                for (int slot = 0; slot < NUM_STAGED; slot++) {
+                    if (wanted[i].staged[slot]) std::atomic_store(&stagedSamples[slot], decoded);
+                }
+                if (wanted[i].play) queueSample(decoded);
+            }
+        }, LOAD_PRIORITY_FOLDER);
+    }
+
+    // Writes a changed recording into the patch storage directory before
+    // returning. Rack archives that directory straight after SaveEvent, so a
+    // write handed to SampleLoadPool could land after the archive and the
+    // patch would reopen without its recording. The cost stays on the UI
+    // thread, bounded by the record buffer and paid only when the take
+    // changed since the last save; the engine is never waited on.
+    void onSave(const SaveEvent& e) override {
+        std::shared_ptr<GranularSample> current = getPublishedSample();
+        if (!current || !current->rawVoltage || !current->path.empty() || isRecording) return;
+        if (!recordingDirty.exchange(false)) return;
+
+        // The engine may start recording into the same buffer while it is
+        // copied; the copy is then dropped and the new take saved next time
+        uint32_t starts = recordingStarts;
+        size_t length = current->length;
+        std::vector<float> snapshot(length);
+        for (size_t i = 0; i < length; i++) snapshot[i] = current->get(i);
+        if (recordingStarts != starts || isRecording) {
+            recordingDirty = true;
+            return;
+        }
+
+        std::string path = system::join(createPatchStorageDirectory(), RECORDING_FILENAME);
+        saveWavMono(path, snapshot.data(), length, current->sampleRate, RECORDING_FULL_SCALE);
+    }
+
+    // Engine thread. Switches playback to `next` and publishes it.
+    void adoptSample(std::shared_ptr<GranularSample> next) {
+        if (!next) return;
+        std::shared_ptr<GranularSample> previous = std::move(sample);
+        sample = std::move(next);
+        activeBufferLen = sample->length;
+        fileSampleRate = sample->sampleRate;
+        pitchTracker.reset();
         grains.clear();
-        bufferIsRawVoltage = false;
-        isLoading = false;
+        publishGrainSnapshot();
         isRecording = false;
+        std::atomic_store(&publishedSample, sample);
+        retireSample(std::move(previous));
+        // Whatever was being waited for has been replaced
+        isLoading = false;
+    }
+
+    // Engine thread. Free slots in the retire ring.
+    uint32_t getRetireSpace() const {
+        return RETIRE_SLOTS - (retireWrite - retireRead);
+    }
+
+    // Engine thread. Callers check getRetireSpace() first; the slot is
+    // always empty, so the assignment frees nothing.
+    void retireSample(std::shared_ptr<GranularSample> old) {
+        if (!old) return;
+        uint32_t write = retireWrite;
+        retiredSamples[write % RETIRE_SLOTS] = std::move(old);
+        retireWrite = write + 1;
+    }
+
+    // UI thread. Frees the samples the engine stopped playing.
+    void collectRetiredSamples() {
+        lastUiCollect = getSteadySeconds();
+        releaseRetiredSamples();
+    }
+
+    // Upkeep thread. Stands in for the widget when it is missing or not
+    // keeping up.
+    void upkeepRetiredSamples() {
+        uint32_t used = retireWrite - retireRead;
+        if (used == 0) return;
+        if (used >= RETIRE_SLOTS / 2 || getSteadySeconds() - lastUiCollect > RETIRE_UI_TIMEOUT) {
+            releaseRetiredSamples();
+        }
+    }
+
+    void releaseRetiredSamples() {
+        std::lock_guard<std::mutex> lock(retireMutex);
+        uint32_t read = retireRead;
+        uint32_t write = retireWrite;
+        for (; read != write; read++) {
+            retiredSamples[read % RETIRE_SLOTS].reset();
+        }
+        retireRead = read;
+    }
+
+    static double getSteadySeconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::shared_ptr<GranularSample> getPublishedSample() {
+        return std::atomic_load(&publishedSample);
+    }
+
+    void publishGrainSnapshot() {
+        GrainSnapshot& snapshot = grainSnapshot.getWriteBuffer();
+        double scale = 1.0 / std::max<size_t>(activeBufferLen, 1);
+        snapshot.count = std::min((int)grains.size(), (int)MAX_GRAINS);
+        for (int i = 0; i < snapshot.count; i++) {
+            const Grain& g = grains[i];
+            snapshot.markers[i].position = (float)(g.bufferPos * scale);
+            snapshot.markers[i].level = g.getEnvelope(g.finalEnvShape) * std::max(g.fadeGain, 0.f);
+        }
+        grainSnapshot.publish();
     }
 };
 
@@ -589,12 +2518,12 @@ void WaveformDisplay::onDragMove(const DragMoveEvent& e) {
 }
 
 
-void WaveformDisplay::regenerateCache() {
-    if (!module || box.size.x <= 0) return;
+void WaveformDisplay::regenerateCache(const GranularSample& source, bool isRecording) {
+    if (box.size.x <= 0) return;
 
-    size_t targetLen = module->isRecording ? module->audioBuffer.size() : module->activeBufferLen;
+    size_t targetLen = isRecording ? source.capacity : source.length.load();
 
-    if (targetLen == 0 || targetLen > module->audioBuffer.size()) {
+    if (targetLen == 0 || targetLen > source.capacity) {
         displayCache.clear();
         displayColorCache.clear();
         return;
@@ -618,28 +2547,28 @@ void WaveformDisplay::regenerateCache() {
         int crossings = 0;
         float prev = 0.f;
 
-        if (startSample < module->audioBuffer.size()) {
-             if (startSample > 0) prev = module->audioBuffer[startSample - 1];
-             else prev = module->audioBuffer[startSample];
+        if (startSample < source.capacity) {
+             if (startSample > 0) prev = source.get(startSample - 1);
+             else prev = source.get(startSample);
         }
 
         if (startSample >= endSample) {
-            if (startSample < module->audioBuffer.size()) {
-                 minSample = maxSample = module->audioBuffer[startSample];
+            if (startSample < source.capacity) {
+                 minSample = maxSample = source.get(startSample);
             } else {
                  minSample = maxSample = 0.f;
             }
         } else {
             for (size_t j = startSample; j < endSample; j++) {
-                if (j >= module->audioBuffer.size()) break;
-                float sample = module->audioBuffer[j];
+                if (j >= source.capacity) break;
+                float sample = source.get(j);
 
                 if ((sample >= 0 && prev < 0) || (sample < 0 && prev >= 0)) {
                     crossings++;
                 }
                 prev = sample;
 
-                if (module->bufferIsRawVoltage) sample /= 5.0f;
+                if (source.rawVoltage) sample /= 5.0f;
 
                 if (sample < minSample) minSample = sample;
                 if (sample > maxSample) maxSample = sample;
@@ -651,7 +2580,7 @@ void WaveformDisplay::regenerateCache() {
 
         displayCache[i] = {minSample, maxSample};
 
-        float duration = (float)(endSample - startSample) / (float)module->fileSampleRate;
+        float duration = (float)(endSample - startSample) / (float)source.sampleRate;
         if (duration <= 0.00001f) duration = 1.0f;
         float freq = (crossings / 2.0f) / duration;
         displayColorCache[i] = getFreqColor(freq);
@@ -672,29 +2601,27 @@ void WaveformDisplay::draw(const DrawArgs& args) {
         return;
     }
 
-    bool isRec = module->isRecording;
+    // Holding the reference keeps the data alive even if the engine moves
+    // on to another sample while we draw
+    std::shared_ptr<GranularSample> sample = module->getPublishedSample();
+    bool isRec = sample && sample->rawVoltage && module->isRecording;
+    size_t currentLen = !sample ? 0 : isRec ? sample->capacity : sample->length.load();
 
-    if (wasRecording && !isRec) {
-        regenerateCache();
+    if (!sample) {
+        displayCache.clear();
     }
-    wasRecording = isRec;
-
-    size_t currentLen = isRec ? module->audioBuffer.size() : module->activeBufferLen;
-
-    if (isRec) {
-        regenerateCache();
-    } else {
-        if (currentLen != cacheBufferSize || box.size.x != cacheBoxWidth) {
-            regenerateCache();
-        }
+    else if (isRec || wasRecording || sample != cacheSample || currentLen != cacheBufferSize || box.size.x != cacheBoxWidth) {
+        regenerateCache(*sample, isRec);
     }
+    cacheSample = sample;
+    wasRecording = isRec;
 
     if (displayCache.empty()) {
         nvgFontSize(args.vg, 14);
         nvgFontFaceId(args.vg, font->handle);
         nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 100));
         nvgTextAlign(args.vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
-        nvgText(args.vg, box.size.x / 2, box.size.y / 2, "Drop WAV or REC", NULL);
+        nvgText(args.vg, box.size.x / 2, box.size.y / 2, "Drop audio, folder or REC", NULL);
         nvgResetScissor(args.vg);
         return;
     }
@@ -721,8 +2648,8 @@ void WaveformDisplay::draw(const DrawArgs& args) {
         nvgStroke(args.vg);
     }
 
-    if (isRec && module->audioBuffer.size() > 0) {
-        float recPos = (float)module->recHead / (float)module->audioBuffer.size();
+    if (isRec && sample->capacity > 0) {
+        float recPos = (float)module->recHead / (float)sample->capacity;
         float recPixel = recPos * box.size.x;
 
         nvgBeginPath(args.vg);
@@ -756,18 +2683,29 @@ void WaveformDisplay::draw(const DrawArgs& args) {
         nvgStroke(args.vg);
     }
 
-    std::vector<Grain>& activeGrains = module->grains;
-    nvgStrokeColor(args.vg, nvgRGBA(0, 150, 255, 255));
+    // Markers fade with their grain's envelope
+    const Granular::GrainSnapshot& grainSnapshot = module->grainSnapshot.read();
     nvgStrokeWidth(args.vg, 1.5f);
-    for (const Grain& grain : activeGrains) {
-        double wrappedBufferPos = std::fmod(grain.bufferPos, (double)currentLen);
-        float grainX = (float)(wrappedBufferPos / currentLen) * box.size.x;
+    for (int i = 0; i < grainSnapshot.count; i++) {
+        const Granular::GrainSnapshot::Marker& marker = grainSnapshot.markers[i];
+        float grainX = rack::math::clamp(marker.position, 0.f, 1.f) * box.size.x;
+        nvgStrokeColor(args.vg, nvgRGBAf(0.f, 150.f / 255.f, 1.f, 0.15f + 0.85f * rack::math::clamp(marker.level, 0.f, 1.f)));
         nvgBeginPath(args.vg);
         nvgMoveTo(args.vg, grainX, 0);
         nvgLineTo(args.vg, grainX, box.size.y);
         nvgStroke(args.vg);
     }
 
+    // Position within a dropped folder
+    if (sample->folderIndex >= 0) {
+        std::string caption = string::f("%d/%d %s", sample->folderIndex + 1, module->folderCount.load(), system::getFilename(sample->path).c_str());
+        nvgFontSize(args.vg, 12);
+        nvgFontFaceId(args.vg, font->handle);
+        nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 150));
+        nvgTextAlign(args.vg, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+        nvgText(args.vg, 4, 4, caption.c_str(), NULL);
+    }
+
     nvgResetScissor(args.vg);
 
     float startX = module->params[Granular::START_PARAM].getValue() * box.size.x;
@@ -869,6 +2807,7 @@ struct SimpleLabel : Widget {
 
 struct GranularWidget : ModuleWidget {
     WaveformDisplay* display = nullptr;
+    bool drawnSinceStep = false;
 
     SimpleLabel* createLabel(Vec pos, std::string text) {
         SimpleLabel* label = new SimpleLabel;
@@ -890,9 +2829,28 @@ struct GranularWidget : ModuleWidget {
         addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(10.0, 65.0)), module, Granular::BPM_PARAM));
         addChild(createLabel(mm2px(Vec(7.0, 58.0)), "BPM"));
 
+        // FOLDER BROWSING
+        addChild(createLabel(mm2px(Vec(5.5, 14.0)), "FILE"));
+        addParam(createParamCentered<TL1105>(mm2px(Vec(6.0, 19.0)), module, Granular::PREV_FILE_PARAM));
+        addParam(createParamCentered<TL1105>(mm2px(Vec(14.0, 19.0)), module, Granular::NEXT_FILE_PARAM));
+        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(10.0, 28.0)), module, Granular::NEXT_FILE_INPUT));
+
         addParam(createParamCentered<CKSS>(mm2px(Vec(10.0, 45.0)), module, Granular::SYNC_PARAM));
         addChild(createLabel(mm2px(Vec(6.5, 38.0)), "SYNC"));
 
+        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(10.0, 85.0)), module, Granular::CLOCK_INPUT));
+        addChild(createLabel(mm2px(Vec(7.0, 78.0)), "CLK"));
+
+        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(10.0, 100.0)), module, Granular::RESET_INPUT));
+        addChild(createLabel(mm2px(Vec(7.0, 93.0)), "RST"));
+
+        addParam(createParamCentered<CKSSThree>(mm2px(Vec(7.0, 116.0)), module, Granular::DIRECTION_PARAM));
+        addParam(createParamCentered<Trimpot>(mm2px(Vec(14.0, 116.0)), module, Granular::R_DIRECTION_PARAM));
+        addChild(createLabel(mm2px(Vec(6.5, 108.0)), "DIR"));
+
+        addParam(createParamCentered<Trimpot>(mm2px(Vec(184.573, 93.0)), module, Granular::SCAN_PARAM));
+        addChild(createLabel(mm2px(Vec(180.0, 88.0)), "SCAN"));
+
 
         // COMPRESSION_PARAM
         addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(184.573, 46.063)), module, Granular::COMPRESSION_PARAM));
@@ -957,48 +2915,185 @@ struct GranularWidget : ModuleWidget {
         addChild(shapeDisplay);
     }
 
+    void appendContextMenu(Menu* menu) override {
+        Granular* granularModule = dynamic_cast<Granular*>(module);
+        if (!granularModule) return;
+        GrainScheduler* scheduler = &granularModule->scheduler;
+
+        ClockTracker* clock = &granularModule->clock;
+        menu->addChild(new MenuSeparator());
+        menu->addChild(createMenuLabel("Clock"));
+        std::vector<std::string> ppqnLabels;
+        for (int i = 0; i < NUM_CLOCK_PPQN; i++) {
+            ppqnLabels.push_back(string::f("%d PPQN", CLOCK_PPQN[i]));
+        }
+        menu->addChild(createIndexSubmenuItem("Clock resolution", ppqnLabels,
+            [=]() {
+                for (int i = 0; i < NUM_CLOCK_PPQN; i++) {
+                    if (CLOCK_PPQN[i] == clock->ppqn) return (size_t)i;
+                }
+                return (size_t)0;
+            },
+            [=](size_t i) { clock->ppqn = CLOCK_PPQN[i]; }
+        ));
+        if (granularModule->inputs[Granular::CLOCK_INPUT].isConnected() && clock->bpm > 0.f) {
+            menu->addChild(createMenuLabel(string::f("Tracked tempo: %.1f BPM", clock->bpm.load())));
+        }
+
+        menu->addChild(new MenuSeparator());
+        menu->addChild(createMenuLabel("Modulation"));
+        menu->addChild(createBoolPtrMenuItem("Audio-rate pitch FM", "", &granularModule->pitchFm));
+        menu->addChild(createBoolPtrMenuItem("Audio-rate position FM", "", &granularModule->positionFm));
+        menu->addChild(createSubmenuItem("Track while playing", "", [=](Menu* menu) {
+            menu->addChild(createMenuLabel("Unticked parameters are latched at spawn"));
+            menu->addChild(createBoolPtrMenuItem("Pitch", "", &granularModule->trackPitch));
+            menu->addChild(createBoolPtrMenuItem("Envelope shape", "", &granularModule->trackShape));
+            menu->addChild(createBoolPtrMenuItem("Size", "", &granularModule->trackSize));
+            menu->addChild(createBoolPtrMenuItem("Loop start / end", "", &granularModule->trackLoop));
+        }));
+
+        menu->addChild(new MenuSeparator());
+        menu->addChild(createMenuLabel("Time-stretch"));
+        menu->addChild(createBoolPtrMenuItem("Scan position at SCAN rate", "", &granularModule->timeStretch));
+        menu->addChild(createBoolPtrMenuItem("Preserve formants", "", &granularModule->preserveFormants));
+        if (granularModule->preserveFormants) {
+            float period = granularModule->formantPeriod;
+            menu->addChild(createMenuLabel(period > 0.f
+                ? string::f("Source pitch: %.1f Hz", granularModule->fileSampleRate / period)
+                : std::string("Source pitch: unvoiced")));
+        }
+
+        OutputSaturator* saturator = &granularModule->saturator;
+        menu->addChild(new MenuSeparator());
+        menu->addChild(createMenuLabel("Output"));
+        menu->addChild(createIndexSubmenuItem("Saturator oversampling", {"Off", "2x", "4x"},
+            [=]() {
+                for (int i = 0; i < NUM_OVERSAMPLE_FACTORS; i++) {
+                    if (OVERSAMPLE_FACTORS[i] == saturator->oversample) return (size_t)i;
+                }
+                return (size_t)0;
+            },
+            [=](size_t i) { saturator->oversample = OVERSAMPLE_FACTORS[i]; }
+        ));
+        menu->addChild(createMenuLabel(string::f("Gain reduction: %.1f dB", granularModule->dynamics.reductionDb.load())));
+
+        menu->addChild(new MenuSeparator());
+        menu->addChild(createMenuLabel("Sample"));
+        menu->addChild(createIndexSubmenuItem("Storage", {"32-bit float", "16-bit integer", "16-bit half float"},
+            [=]() { return (size_t)granularModule->storageFormat.load(); },
+            [=](size_t i) {
+                if ((int)i == granularModule->storageFormat) return;
+                granularModule->storageFormat = (int)i;
+                // Reconvert the loaded file; a recording keeps its format
+                // until the next one starts.
+                std::shared_ptr<GranularSample> current = granularModule->getPublishedSample();
+                if (current && current->rawVoltage) return;
+                if (!granularModule->folderPath.empty()) granularModule->reloadFolder();
+                else if (current && !current->path.empty()) granularModule->loadSampleAsync(current->path, false);
+            }
+        ));
+
+        menu->addChild(new MenuSeparator());
+        menu->addChild(createMenuLabel("Grain scheduler"));
+
+        std::vector<std::string> budgetLabels;
+        for (int i = 0; i < NUM_GRAIN_BUDGETS; i++) {
+            budgetLabels.push_back(string::f("%d grains", GRAIN_BUDGETS[i]));
+        }
+        menu->addChild(createIndexSubmenuItem("Grain budget", budgetLabels,
+            [=]() {
+                for (int i = 0; i < NUM_GRAIN_BUDGETS; i++) {
+                    if (GRAIN_BUDGETS[i] >= scheduler->budget) return (size_t)i;
+                }
+                return (size_t)(NUM_GRAIN_BUDGETS - 1);
+            },
+            [=](size_t i) { scheduler->budget = GRAIN_BUDGETS[i]; }
+        ));
+        menu->addChild(createIndexPtrSubmenuItem("Over budget",
+            {"Drop new grain", "Steal oldest", "Steal quietest", "Steal nearest to end"},
+            &scheduler->policy
+        ));
+
+        menu->addChild(createBoolPtrMenuItem("CPU-adaptive density", "", &scheduler->adaptive));
+        std::vector<std::string> targetLabels;
+        for (int i = 0; i < NUM_ADAPTIVE_TARGETS; i++) {
+            targetLabels.push_back(string::f("%.0f%% of block", 100.f * ADAPTIVE_TARGETS[i]));
+        }
+        menu->addChild(createIndexSubmenuItem("Adaptive target", targetLabels,
+            [=]() {
+                for (int i = 0; i < NUM_ADAPTIVE_TARGETS; i++) {
+                    if (ADAPTIVE_TARGETS[i] >= scheduler->targetLoad - 1e-4f) return (size_t)i;
+                }
+                return (size_t)(NUM_ADAPTIVE_TARGETS - 1);
+            },
+            [=](size_t i) { scheduler->targetLoad = ADAPTIVE_TARGETS[i]; },
+            !scheduler->adaptive
+        ));
+        if (scheduler->adaptive) {
+            menu->addChild(createMenuLabel(string::f("Render load: %.0f%%, density: %.0f%%", 100.f * scheduler->load.load(), 100.f * scheduler->publishedScale.load())));
+        }
+        menu->addChild(createMenuLabel(string::f("Stolen grains: %llu", (unsigned long long)scheduler->steals.load())));
+        menu->addChild(createBoolPtrMenuItem(string::f("Plan spawns per %d-sample block", GrainScheduler::PLAN_BLOCK), "", &scheduler->planBlocks));
+
+#ifdef GRANULAR_PROFILE
+        GranularProfiler& p = granularModule->profiler;
+
+        menu->addChild(new MenuSeparator());
+        menu->addChild(createMenuLabel("DSP profile"));
+        menu->addChild(createMenuLabel(string::f("Live grains: %d / %d", p.liveGrains.load(), scheduler->budget)));
+        menu->addChild(createMenuLabel(string::f("Spawn rate: %.1f /s", p.spawnRate.load())));
+        menu->addChild(createMenuLabel(string::f("Dropped spawns: %llu", (unsigned long long)p.drops.load())));
+        menu->addChild(createMenuLabel(string::f("Block (%d) avg: %.1f us, peak: %.1f us", GranularProfiler::BLOCK_SIZE, p.avgBlockUs.load(), p.peakBlockUs.load())));
+        menu->addChild(createMenuLabel(string::f("Spawn %.0f%%  Render %.0f%%  Saturate %.0f%%  Record %.0f%%",
+            100.f * p.stageShare[GranularProfiler::STAGE_SPAWN],
+            100.f * p.stageShare[GranularProfiler::STAGE_RENDER],
+            100.f * p.stageShare[GranularProfiler::STAGE_SATURATE],
+            100.f * p.stageShare[GranularProfiler::STAGE_RECORD])));
+#endif
+    }
+
+    void step() override {
+        Granular* granularModule = dynamic_cast<Granular*>(module);
+        if (granularModule) {
+            // Before collecting, so the retired file can be restaged
+            granularModule->updateFolder();
+            granularModule->collectRetiredSamples();
+            granularModule->updateLoadPriority(drawnSinceStep);
+        }
+        drawnSinceStep = false;
+        ModuleWidget::step();
+    }
+
+    // Rack only draws widgets inside the viewport
+    void draw(const DrawArgs& args) override {
+        drawnSinceStep = true;
+        ModuleWidget::draw(args);
+    }
+
     void onPathDrop(const PathDropEvent& e) override {
         if (e.paths.empty()) return;
 
         std::string path = e.paths[0];
-        std::string extension = rack::system::getExtension(path);
 
-        if (extension == ".wav") {
+        if (system::isDirectory(path)) {
             if (module) {
                 Granular* granularModule = dynamic_cast<Granular*>(module);
                 if (!granularModule) return;
 
-                granularModule->isLoading = true;
+                if (!granularModule->loadFolder(path, 0)) return;
 
-                unsigned int channels;
-                unsigned int sampleRate;
-                drwav_uint64 totalFrames;
-                float* pSampleData = drwav_open_file_and_read_pcm_frames_f32(path.c_str(), &channels, &sampleRate, &totalFrames, NULL);
-
-                if (pSampleData == NULL) {
-                    granularModule->isLoading = false;
-                    return;
-                }
-
-                std::vector<float> newBuffer;
-                newBuffer.resize(totalFrames);
-
-                if (channels == 1) {
-                    std::memcpy(newBuffer.data(), pSampleData, totalFrames * sizeof(float));
-                } else {
-                    for (drwav_uint64 i = 0; i < totalFrames; i++) {
-                        newBuffer[i] = (pSampleData[i * channels + 0] + pSampleData[i * channels + 1]) * 0.5f;
-                    }
-                }
+                granularModule->params[Granular::LIVE_REC_PARAM].setValue(0.f);
+            }
+        }
+        else if (isSupportedSampleFile(path)) {
+            if (module) {
+                Granular* granularModule = dynamic_cast<Granular*>(module);
+                if (!granularModule) return;
 
-                drwav_free(pSampleData, NULL);
-                granularModule->setBuffer(newBuffer, sampleRate);
+                granularModule->clearFolder();
+                granularModule->loadSampleAsync(path, false);
 
                 granularModule->params[Granular::LIVE_REC_PARAM].setValue(0.f);
-
-                if (display) {
-                    display->cacheBufferSize = 0;
-                }
             }
         }
     }
@@ -1,5 +1,6 @@
 #include "plugin.hpp"
 #include <iostream>
+#include <map>
 
 Plugin *pluginInstance;
 
@@ -41,237 +42,210 @@ void BidooWidget::appendContextMenu(Menu *menu) {
 	ModuleWidget::appendContextMenu(menu);
 	menu->addChild(new MenuSeparator());
 	menu->addChild(createSubmenuItem("Theme", "", [=](ui::Menu* menu) {
-		menu->addChild(construct<LightItem>(&MenuItem::text, dynamic_cast<BidooModule*>(module)->themeId == 0 ? "Light ✓" : "Light", &LightItem::module, dynamic_cast<BidooModule*>(module), &LightItem::pWidget, dynamic_cast<BidooWidget*>(this)));
-		menu->addChild(construct<DarkItem>(&MenuItem::text, dynamic_cast<BidooModule*>(module)->themeId == 1 ? "Dark ✓" : "Dark", &DarkItem::module, dynamic_cast<BidooModule*>(module), &DarkItem::pWidget, dynamic_cast<BidooWidget*>(this)));
-		menu->addChild(construct<BlackItem>(&MenuItem::text, dynamic_cast<BidooModule*>(module)->themeId == 2 ? "Black ✓" : "Black", &BlackItem::module, dynamic_cast<BidooModule*>(module), &BlackItem::pWidget, dynamic_cast<BidooWidget*>(this)));
-		menu->addChild(construct<BlueItem>(&MenuItem::text, dynamic_cast<BidooModule*>(module)->themeId == 3 ? "Blue ✓" : "Blue", &BlueItem::module, dynamic_cast<BidooModule*>(module), &BlueItem::pWidget, dynamic_cast<BidooWidget*>(this)));
-		menu->addChild(construct<GreenItem>(&MenuItem::text, dynamic_cast<BidooModule*>(module)->themeId == 4 ? "Green ✓" : "Green", &GreenItem::module, dynamic_cast<BidooModule*>(module), &GreenItem::pWidget, dynamic_cast<BidooWidget*>(this)));
+		BidooModule* bidooModule = dynamic_cast<BidooModule*>(module);
+		for (int i = 0; i < NUM_THEMES; i++) {
+			std::string name = getThemeName(i);
+			menu->addChild(construct<ThemeItem>(&MenuItem::text, bidooModule->themeId == i ? name + " ✓" : name, &ThemeItem::module, bidooModule, &ThemeItem::pWidget, this, &ThemeItem::themeId, i));
+		}
 	}));
 }
 
-unsigned int packedColor(int r, int g, int b, int a) {
+constexpr unsigned int packedColor(int r, int g, int b, int a) {
 	return r + (g << 8) + (b << 16) + (a << 24);
 }
 
-void BidooWidget::writeThemeAndContrastAsDefault() {
-	json_t *settingsJ = json_object();
+BidooSettings bidooSettings;
 
-	// defaultPanelTheme
-	json_object_set_new(settingsJ, "themeDefault", json_integer(defaultPanelTheme));
+// Seconds to wait after the last change before writing Bidoo.json
+static const double SETTINGS_WRITE_DELAY = 1.0;
 
-	std::string settingsFilename = asset::user("Bidoo.json");
-	FILE *file = fopen(settingsFilename.c_str(), "w");
-	if (file) {
-		json_dumpf(settingsJ, file, JSON_INDENT(2) | JSON_REAL_PRECISION(9));
-		fclose(file);
-	}
-	json_decref(settingsJ);
-}
+void BidooSettings::load() {
+	loaded = true;
+	themeDefault = 0;
 
-void BidooWidget::readThemeAndContrastFromDefault() {
 	std::string settingsFilename = asset::user("Bidoo.json");
 	FILE *file = fopen(settingsFilename.c_str(), "r");
 	if (!file) {
-		defaultPanelTheme = 0;
-		writeThemeAndContrastAsDefault();
 		return;
 	}
 	json_error_t error;
 	json_t *settingsJ = json_loadf(file, 0, &error);
+	fclose(file);
 	if (!settingsJ) {
-		fclose(file);
-		defaultPanelTheme = 0;
-		writeThemeAndContrastAsDefault();
 		return;
 	}
 
-	// defaultPanelTheme
 	json_t *themeDefaultJ = json_object_get(settingsJ, "themeDefault");
 	if (themeDefaultJ) {
-		defaultPanelTheme = json_integer_value(themeDefaultJ);
-	}
-	else {
-		defaultPanelTheme = 0;
+		themeDefault = json_integer_value(themeDefaultJ);
 	}
 
-	fclose(file);
 	json_decref(settingsJ);
-	return;
 }
 
-void BidooWidget::prepareThemes(const std::string& filename) {
-	readThemeAndContrastFromDefault();
-
-	setPanel(APP->window->loadSvg(filename));
-	lightPanel = dynamic_cast<SvgPanel*>(getPanel());
+int BidooSettings::getThemeDefault() {
+	if (!loaded) {
+		load();
+	}
+	return themeDefault;
+}
 
-	std::shared_ptr<Svg> dSvg;
-	try {
-		dSvg = std::make_shared<Svg>();
-		dSvg->loadFile(filename);
+void BidooSettings::setThemeDefault(int themeId) {
+	if (!loaded) {
+		load();
 	}
-	catch (Exception& e) {
-		WARN("%s", e.what());
-		dSvg = NULL;
+	if (themeId == themeDefault) {
+		return;
 	}
+	themeDefault = themeId;
+	version++;
+	dirty = true;
+	dirtyTime = system::getTime();
+}
 
-	darkPanel = new SvgPanel;
-	darkPanel->setBackground(dSvg);
-	for (NSVGshape *shape = darkPanel->sw->svg->handle->shapes; shape != NULL; shape = shape->next) {
-		std::string sId (shape->id);
-		std::string sScreen ("screen");
-		bool isScreen = sId.find(sScreen)!=std::string::npos;
-
-		if ((shape->fill.color == packedColor(205, 31, 0, 255)) || (shape->stroke.color == packedColor(205, 31, 0, 255))) {
-			shape->fill.color = packedColor(150, 0, 0, 255);
-			shape->stroke.color = packedColor(150, 0, 0, 255);
-		}
-		if (((shape->fill.color == packedColor(0, 0, 0, 255)) || (shape->stroke.color == packedColor(0, 0, 0, 255))) && (!isScreen)) {
-			shape->fill.color = packedColor(180, 180, 180, 255);
-			shape->stroke.color = packedColor(180, 180, 180, 255);
-		}
-		if ((shape->fill.color == packedColor(230, 230, 230, 255)) || (shape->stroke.color == packedColor(230, 230, 230, 255))) {
-			shape->fill.color = packedColor(50, 50, 50, 255);
-			shape->stroke.color = packedColor(50, 50, 50, 255);
-		}
-		if ((shape->fill.color == packedColor(255, 255, 255, 255)) || (shape->stroke.color == packedColor(255, 255, 255, 255))) {
-			shape->fill.color = packedColor(40, 40, 40, 255);
-			shape->stroke.color = packedColor(40, 40, 40, 255);
-		}
-		if (shape->opacity<1) {
-			shape->fill.color = packedColor(80, 80, 80, 255);
-			shape->stroke.color = packedColor(80, 80, 80, 255);
-			shape->opacity = 0.6f;
-		}
+void BidooSettings::step() {
+	if (dirty && system::getTime() - dirtyTime >= SETTINGS_WRITE_DELAY) {
+		flush();
 	}
-	darkPanel->setVisible(false);
-	addChild(darkPanel);
+}
 
-	std::shared_ptr<Svg> bSvg;
-	try {
-		bSvg = std::make_shared<Svg>();
-		bSvg->loadFile(filename);
+void BidooSettings::flush() {
+	if (!dirty) {
+		return;
 	}
-	catch (Exception& e) {
-		WARN("%s", e.what());
-		bSvg = NULL;
+	dirty = false;
+
+	json_t *settingsJ = json_object();
+
+	// defaultPanelTheme
+	json_object_set_new(settingsJ, "themeDefault", json_integer(themeDefault));
+
+	std::string settingsFilename = asset::user("Bidoo.json");
+	FILE *file = fopen(settingsFilename.c_str(), "w");
+	if (file) {
+		json_dumpf(settingsJ, file, JSON_INDENT(2) | JSON_REAL_PRECISION(9));
+		fclose(file);
 	}
+	json_decref(settingsJ);
+}
 
-	blackPanel = new SvgPanel;
-	blackPanel->setBackground(bSvg);
-	for (NSVGshape *shape = blackPanel->sw->svg->handle->shapes; shape != NULL; shape = shape->next) {
-		std::string sId (shape->id);
-		std::string sScreen ("screen");
-		bool isScreen = sId.find(sScreen)!=std::string::npos;
+void BidooWidget::writeThemeAndContrastAsDefault() {
+	bidooSettings.setThemeDefault(defaultPanelTheme);
+}
 
-		if ((shape->fill.color == packedColor(205, 31, 0, 255)) || (shape->stroke.color == packedColor(205, 31, 0, 255))) {
-			shape->fill.color = packedColor(150, 0, 0, 255);
-			shape->stroke.color = packedColor(150, 0, 0, 255);
-		}
-		if (((shape->fill.color == packedColor(0, 0, 0, 255)) || (shape->stroke.color == packedColor(0, 0, 0, 255))) && (!isScreen)) {
-			shape->fill.color = packedColor(180, 180, 180, 255);
-			shape->stroke.color = packedColor(180, 180, 180, 255);
-		}
-		if ((shape->fill.color == packedColor(230, 230, 230, 255)) || (shape->stroke.color == packedColor(230, 230, 230, 255))) {
-			shape->fill.color = packedColor(0, 0, 0, 255);
-			shape->stroke.color = packedColor(0, 0, 0, 255);
-		}
-		if ((shape->fill.color == packedColor(255, 255, 255, 255)) || (shape->stroke.color == packedColor(255, 255, 255, 255))) {
-			shape->fill.color = packedColor(40, 40, 40, 255);
-			shape->stroke.color = packedColor(40, 40, 40, 255);
+void BidooWidget::readThemeAndContrastFromDefault() {
+	defaultPanelTheme = bidooSettings.getThemeDefault();
+}
+
+// --- THEME TABLE ---
+// Each theme is a list of colour remaps applied in order to the light panel.
+// A shape matching a rule on fill or stroke gets both replaced.
+
+struct ColourRule {
+	unsigned int from;
+	unsigned int to;
+	bool skipScreens;
+};
+
+struct ThemeDescriptor {
+	const char* name;
+	std::vector<ColourRule> rules;
+	// Colour for translucent shapes, which are also set to 0.6 opacity. 0 leaves them alone.
+	unsigned int translucent;
+};
+
+static std::vector<ColourRule> darkRules(unsigned int background) {
+	return {
+		{packedColor(205, 31, 0, 255), packedColor(150, 0, 0, 255), false},
+		{packedColor(0, 0, 0, 255), packedColor(180, 180, 180, 255), true},
+		{packedColor(230, 230, 230, 255), background, false},
+		{packedColor(255, 255, 255, 255), packedColor(40, 40, 40, 255), false},
+	};
+}
+
+static const ThemeDescriptor themeTable[NUM_THEMES] = {
+	{"Light", {}, 0},
+	{"Dark", darkRules(packedColor(50, 50, 50, 255)), packedColor(80, 80, 80, 255)},
+	{"Black", darkRules(packedColor(0, 0, 0, 255)), packedColor(60, 60, 60, 255)},
+	{"Blue", darkRules(packedColor(19, 63, 84, 255)), packedColor(60, 60, 60, 255)},
+	{"Green", darkRules(packedColor(19, 107, 80, 255)), packedColor(60, 60, 60, 255)},
+};
+
+const char* getThemeName(int themeId) {
+	return themeTable[math::clamp(themeId, 0, NUM_THEMES - 1)].name;
+}
+
+static void recolourSvg(std::shared_ptr<Svg> svg, const ThemeDescriptor& theme) {
+	for (NSVGshape *shape = svg->handle->shapes; shape != NULL; shape = shape->next) {
+		bool isScreen = std::strstr(shape->id, "screen") != NULL;
+
+		for (const ColourRule& rule : theme.rules) {
+			if (rule.skipScreens && isScreen) {
+				continue;
+			}
+			if ((shape->fill.color == rule.from) || (shape->stroke.color == rule.from)) {
+				shape->fill.color = rule.to;
+				shape->stroke.color = rule.to;
+			}
 		}
-		if (shape->opacity<1) {
-			shape->fill.color = packedColor(60, 60, 60, 255);
-			shape->stroke.color = packedColor(60, 60, 60, 255);
+		if (theme.translucent && shape->opacity < 1) {
+			shape->fill.color = theme.translucent;
+			shape->stroke.color = theme.translucent;
 			shape->opacity = 0.6f;
 		}
 	}
-	blackPanel->setVisible(false);
-	addChild(blackPanel);
+}
 
-	std::shared_ptr<Svg> buSvg;
-	try {
-		buSvg = std::make_shared<Svg>();
-		buSvg->loadFile(filename);
-	}
-	catch (Exception& e) {
-		WARN("%s", e.what());
-		buSvg = NULL;
-	}
+// Themed panels are parsed and recoloured once per (file, theme) and shared by
+// every widget using them. The light theme is the unmodified file, which Rack
+// already caches.
+static std::map<std::pair<std::string, int>, std::shared_ptr<Svg>> themedSvgCache;
 
-	bluePanel = new SvgPanel;
-	bluePanel->setBackground(buSvg);
-	for (NSVGshape *shape = bluePanel->sw->svg->handle->shapes; shape != NULL; shape = shape->next) {
-		std::string sId (shape->id);
-		std::string sScreen ("screen");
-		bool isScreen = sId.find(sScreen)!=std::string::npos;
+std::shared_ptr<Svg> getThemedSvg(const std::string& filename, int themeId) {
+	themeId = math::clamp(themeId, 0, NUM_THEMES - 1);
+	if (themeId == 0) {
+		return APP->window->loadSvg(filename);
+	}
 
-		if ((shape->fill.color == packedColor(205, 31, 0, 255)) || (shape->stroke.color == packedColor(205, 31, 0, 255))) {
-			shape->fill.color = packedColor(150, 0, 0, 255);
-			shape->stroke.color = packedColor(150, 0, 0, 255);
-		}
-		if (((shape->fill.color == packedColor(0, 0, 0, 255)) || (shape->stroke.color == packedColor(0, 0, 0, 255))) && (!isScreen)) {
-			shape->fill.color = packedColor(180, 180, 180, 255);
-			shape->stroke.color = packedColor(180, 180, 180, 255);
-		}
-		if ((shape->fill.color == packedColor(230, 230, 230, 255)) || (shape->stroke.color == packedColor(230, 230, 230, 255))) {
-			shape->fill.color = packedColor(19, 63, 84, 255);
-			shape->stroke.color = packedColor(19, 63, 84, 255);
-		}
-		if ((shape->fill.color == packedColor(255, 255, 255, 255)) || (shape->stroke.color == packedColor(255, 255, 255, 255))) {
-			shape->fill.color = packedColor(40, 40, 40, 255);
-			shape->stroke.color = packedColor(40, 40, 40, 255);
-		}
-		if (shape->opacity<1) {
-			shape->fill.color = packedColor(60, 60, 60, 255);
-			shape->stroke.color = packedColor(60, 60, 60, 255);
-			shape->opacity = 0.6f;
-		}
+	auto key = std::make_pair(filename, themeId);
+	auto it = themedSvgCache.find(key);
+	if (it != themedSvgCache.end()) {
+		return it->second;
 	}
-	bluePanel->setVisible(false);
-	addChild(bluePanel);
 
-	std::shared_ptr<Svg> gSvg;
+	std::shared_ptr<Svg> svg;
 	try {
-		gSvg = std::make_shared<Svg>();
-		gSvg->loadFile(filename);
+		svg = std::make_shared<Svg>();
+		svg->loadFile(filename);
+		recolourSvg(svg, themeTable[themeId]);
 	}
 	catch (Exception& e) {
 		WARN("%s", e.what());
-		gSvg = NULL;
+		svg = NULL;
 	}
 
-	greenPanel = new SvgPanel;
-	greenPanel->setBackground(gSvg);
-	for (NSVGshape *shape = greenPanel->sw->svg->handle->shapes; shape != NULL; shape = shape->next) {
-		std::string sId (shape->id);
-		std::string sScreen ("screen");
-		bool isScreen = sId.find(sScreen)!=std::string::npos;
+	themedSvgCache[key] = svg;
+	return svg;
+}
+
+void BidooWidget::prepareThemes(const std::string& filename) {
+	readThemeAndContrastFromDefault();
 
-		if ((shape->fill.color == packedColor(205, 31, 0, 255)) || (shape->stroke.color == packedColor(205, 31, 0, 255))) {
-			shape->fill.color = packedColor(150, 0, 0, 255);
-			shape->stroke.color = packedColor(150, 0, 0, 255);
-		}
-		if (((shape->fill.color == packedColor(0, 0, 0, 255)) || (shape->stroke.color == packedColor(0, 0, 0, 255))) && (!isScreen)) {
-			shape->fill.color = packedColor(180, 180, 180, 255);
-			shape->stroke.color = packedColor(180, 180, 180, 255);
-		}
-		if ((shape->fill.color == packedColor(230, 230, 230, 255)) || (shape->stroke.color == packedColor(230, 230, 230, 255))) {
-			shape->fill.color = packedColor(19, 107, 80, 255);
-			shape->stroke.color = packedColor(19, 107, 80, 255);
-		}
-		if ((shape->fill.color == packedColor(255, 255, 255, 255)) || (shape->stroke.color == packedColor(255, 255, 255, 255))) {
-			shape->fill.color = packedColor(40, 40, 40, 255);
-			shape->stroke.color = packedColor(40, 40, 40, 255);
-		}
-		if (shape->opacity<1) {
-			shape->fill.color = packedColor(60, 60, 60, 255);
-			shape->stroke.color = packedColor(60, 60, 60, 255);
-			shape->opacity = 0.6f;
-		}
+	panelFilename = filename;
+	setPanel(getThemedSvg(filename, 0));
+	activePanel = dynamic_cast<SvgPanel*>(getPanel());
+	activeTheme = 0;
+}
+
+void BidooWidget::showTheme(int themeId) {
+	if (themeId == activeTheme || !activePanel) {
+		return;
+	}
+	std::shared_ptr<Svg> svg = getThemedSvg(panelFilename, themeId);
+	if (svg) {
+		activePanel->setBackground(svg);
+		activeTheme = themeId;
 	}
-	greenPanel->setVisible(false);
-	addChild(greenPanel);
 }
 
 void BidooWidget::step() {
@@ -280,118 +254,19 @@ void BidooWidget::step() {
 			dynamic_cast<BidooModule*>(module)->loadDefault = false;
 			readThemeAndContrastFromDefault();
 			dynamic_cast<BidooModule*>(module)->themeId = defaultPanelTheme;
-			if (defaultPanelTheme == 0) {
-				lightPanel->setVisible(true);
-				darkPanel->setVisible(false);
-				blackPanel->setVisible(false);
-				bluePanel->setVisible(false);
-				greenPanel->setVisible(false);
-			}
-			else if (defaultPanelTheme == 1) {
-				lightPanel->setVisible(false);
-				darkPanel->setVisible(true);
-				blackPanel->setVisible(false);
-				bluePanel->setVisible(false);
-				greenPanel->setVisible(false);
-			}
-			else if (defaultPanelTheme == 2){
-				lightPanel->setVisible(false);
-				darkPanel->setVisible(false);
-				blackPanel->setVisible(true);
-				bluePanel->setVisible(false);
-				greenPanel->setVisible(false);
-			}
-			else if (defaultPanelTheme == 3){
-				lightPanel->setVisible(false);
-				darkPanel->setVisible(false);
-				blackPanel->setVisible(false);
-				bluePanel->setVisible(true);
-				greenPanel->setVisible(false);
-			}
-			else {
-				lightPanel->setVisible(false);
-				darkPanel->setVisible(false);
-				blackPanel->setVisible(false);
-				bluePanel->setVisible(false);
-				greenPanel->setVisible(true);
-			}
+			showTheme(defaultPanelTheme);
 		}
 		else if (dynamic_cast<BidooModule*>(module)->themeChanged) {
 			dynamic_cast<BidooModule*>(module)->themeChanged = false;
-			if (dynamic_cast<BidooModule*>(module)->themeId == 0) {
-				lightPanel->setVisible(true);
-				darkPanel->setVisible(false);
-				blackPanel->setVisible(false);
-				bluePanel->setVisible(false);
-				greenPanel->setVisible(false);
-			}
-			else if (dynamic_cast<BidooModule*>(module)->themeId == 1) {
-				lightPanel->setVisible(false);
-				darkPanel->setVisible(true);
-				blackPanel->setVisible(false);
-				bluePanel->setVisible(false);
-				greenPanel->setVisible(false);
-			}
-			else if (dynamic_cast<BidooModule*>(module)->themeId == 2){
-				lightPanel->setVisible(false);
-				darkPanel->setVisible(false);
-				blackPanel->setVisible(true);
-				bluePanel->setVisible(false);
-				greenPanel->setVisible(false);
-			}
-			else if (dynamic_cast<BidooModule*>(module)->themeId == 3){
-				lightPanel->setVisible(false);
-				darkPanel->setVisible(false);
-				blackPanel->setVisible(false);
-				bluePanel->setVisible(true);
-				greenPanel->setVisible(false);
-			}
-			else {
-				lightPanel->setVisible(false);
-				darkPanel->setVisible(false);
-				blackPanel->setVisible(false);
-				bluePanel->setVisible(false);
-				greenPanel->setVisible(true);
-			}
+			showTheme(dynamic_cast<BidooModule*>(module)->themeId);
 		}
 	}
-	else {
+	else if (settingsVersion != bidooSettings.version) {
+		// Module browser previews follow the default theme
+		settingsVersion = bidooSettings.version;
 		readThemeAndContrastFromDefault();
-		if (defaultPanelTheme == 0) {
-			lightPanel->setVisible(true);
-			darkPanel->setVisible(false);
-			blackPanel->setVisible(false);
-			bluePanel->setVisible(false);
-			greenPanel->setVisible(false);
-		}
-		else if (defaultPanelTheme == 1) {
-			lightPanel->setVisible(false);
-			darkPanel->setVisible(true);
-			blackPanel->setVisible(false);
-			bluePanel->setVisible(false);
-			greenPanel->setVisible(false);
-		}
-		else if (defaultPanelTheme == 2){
-			lightPanel->setVisible(false);
-			darkPanel->setVisible(false);
-			blackPanel->setVisible(true);
-			bluePanel->setVisible(false);
-			greenPanel->setVisible(false);
-		}
-		else if (defaultPanelTheme == 3){
-			lightPanel->setVisible(false);
-			darkPanel->setVisible(false);
-			blackPanel->setVisible(false);
-			bluePanel->setVisible(true);
-			greenPanel->setVisible(false);
-		}
-		else {
-			lightPanel->setVisible(false);
-			darkPanel->setVisible(false);
-			blackPanel->setVisible(false);
-			bluePanel->setVisible(false);
-			greenPanel->setVisible(true);
-		}
+		showTheme(defaultPanelTheme);
 	}
+	bidooSettings.step();
 	ModuleWidget::step();
 }
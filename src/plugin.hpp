@@ -1,3 +1,4 @@
+#pragma once
 #include "rack.hpp"
 
 using namespace rack;
@@ -34,69 +35,58 @@ struct BidooModule : Module {
 	void dataFromJson(json_t *rootJ) override;
 };
 
+// Plugin-wide settings mirrored from Bidoo.json. The file is read once on first
+// use and written back shortly after the last change instead of on every edit.
+struct BidooSettings {
+	int themeDefault = 0;
+	// Bumped on every change so live widgets can notice it without re-reading.
+	int version = 0;
+	bool loaded = false;
+	bool dirty = false;
+	double dirtyTime = 0.0;
+
+	void load();
+	int getThemeDefault();
+	void setThemeDefault(int themeId);
+	void step();
+	void flush();
+};
+
+extern BidooSettings bidooSettings;
+
+// Panel themes: light, dark, black, blue, green.
+static const int NUM_THEMES = 5;
+
+const char* getThemeName(int themeId);
+
+// Returns the panel SVG recoloured for a theme, shared plugin-wide.
+std::shared_ptr<Svg> getThemedSvg(const std::string& filename, int themeId);
+
 struct BidooWidget : ModuleWidget {
-	SvgPanel* lightPanel;
-	SvgPanel* darkPanel;
-	SvgPanel* blackPanel;
-	SvgPanel* bluePanel;
-	SvgPanel* greenPanel;
+	// Single panel whose background is swapped to the cached themed SVG,
+	// so widgets only reference the themes they actually show.
+	SvgPanel* activePanel = nullptr;
+	int activeTheme = 0;
+	std::string panelFilename;
 	int defaultPanelTheme = 0;
+	int settingsVersion = -1;
 
 	BidooWidget() {
 		readThemeAndContrastFromDefault();
 	}
 
-	struct LightItem : MenuItem {
-		BidooModule *module;
-		BidooWidget *pWidget;
-		void onAction(const event::Action &e) override {
-			module->themeId = 0;
-			module->themeChanged = true;
-			pWidget->defaultPanelTheme = 0;
-			pWidget->writeThemeAndContrastAsDefault();
-		}
-	};
-
-	struct DarkItem : MenuItem {
-		BidooModule *module;
-		BidooWidget *pWidget;
-		void onAction(const event::Action &e) override {
-			module->themeId = 1;
-			module->themeChanged = true;
-			pWidget->defaultPanelTheme = 1;
-			pWidget->writeThemeAndContrastAsDefault();
-		}
-	};
-
-	struct BlackItem : MenuItem {
-		BidooModule *module;
-		BidooWidget *pWidget;
-		void onAction(const event::Action &e) override {
-			module->themeId = 2;
-			module->themeChanged = true;
-			pWidget->defaultPanelTheme = 2;
-			pWidget->writeThemeAndContrastAsDefault();
-		}
-	};
-
-	struct BlueItem : MenuItem {
-		BidooModule *module;
-		BidooWidget *pWidget;
-		void onAction(const event::Action &e) override {
-			module->themeId = 3;
-			module->themeChanged = true;
-			pWidget->defaultPanelTheme = 3;
-			pWidget->writeThemeAndContrastAsDefault();
-		}
-	};
+	~BidooWidget() {
+		bidooSettings.flush();
+	}
 
-	struct GreenItem : MenuItem {
+	struct ThemeItem : MenuItem {
 		BidooModule *module;
 		BidooWidget *pWidget;
+		int themeId;
 		void onAction(const event::Action &e) override {
-			module->themeId = 4;
+			module->themeId = themeId;
 			module->themeChanged = true;
-			pWidget->defaultPanelTheme = 4;
+			pWidget->defaultPanelTheme = themeId;
 			pWidget->writeThemeAndContrastAsDefault();
 		}
 	};
@@ -104,6 +94,7 @@ struct BidooWidget : ModuleWidget {
 	void writeThemeAndContrastAsDefault();
 	void readThemeAndContrastFromDefault();
 	void prepareThemes(const std::string& filename);
+	void showTheme(int themeId);
 	void appendContextMenu(Menu *menu) override;
 	void step() override;
 };
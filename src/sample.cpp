@@ -0,0 +1,291 @@
+#include "sample.hpp"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+
+#include "dr_wav.h"
+#include "dr_flac.h"
+#include "minimp3_ex.h"
+
+bool saveWavMono(const std::string& path, const float* data, size_t length, unsigned int sampleRate, float fullScale) {
+    drwav_data_format format;
+    format.container = drwav_container_riff;
+    format.format = DR_WAVE_FORMAT_PCM;
+    format.channels = 1;
+    format.sampleRate = sampleRate;
+    format.bitsPerSample = 16;
+
+    drwav wav;
+    if (!drwav_init_file_write(&wav, path.c_str(), &format, NULL)) {
+        return false;
+    }
+
+    // Convert in chunks so a long recording never needs a second full copy
+    const size_t CHUNK = 4096;
+    int16_t pcm[CHUNK];
+    float scale = 1.f / fullScale;
+    size_t written = 0;
+    while (written < length) {
+        size_t n = std::min(CHUNK, length - written);
+        for (size_t i = 0; i < n; i++) {
+            // Rounded, not truncated, so quiet passages keep their level
+            // and no bias towards zero builds up
+            float v = std::max(-1.f, std::min(data[written + i] * scale, 1.f));
+            pcm[i] = (int16_t)std::lrint(v * 32767.f);
+        }
+        if (drwav_write_pcm_frames(&wav, n, pcm) != n) break;
+        written += n;
+    }
+    drwav_uninit(&wav);
+    return written == length;
+}
+
+// Decoders read interleaved frames into a scratch buffer and mix them down
+// into the caller's chunk, so memory stays at one chunk whatever the file
+// length.
+static void mixToMono(const float* interleaved, unsigned int channels, size_t frames, float* out) {
+    if (channels == 1) {
+        std::memcpy(out, interleaved, frames * sizeof(float));
+        return;
+    }
+    for (size_t i = 0; i < frames; i++) {
+        out[i] = (interleaved[i * channels + 0] + interleaved[i * channels + 1]) * 0.5f;
+    }
+}
+
+// WAV and AIFF, both read by dr_wav
+struct WavDecoder : SampleDecoder {
+    drwav wav;
+    bool opened = false;
+    std::vector<float> scratch;
+
+    ~WavDecoder() {
+        if (opened) drwav_uninit(&wav);
+    }
+
+    bool open(const std::string& path) {
+        opened = drwav_init_file(&wav, path.c_str(), NULL);
+        if (!opened) return false;
+        sampleRate = wav.sampleRate;
+        channels = wav.channels;
+        length = wav.totalPCMFrameCount;
+        return channels > 0;
+    }
+
+    size_t read(float* out, size_t frames) override {
+        scratch.resize(frames * channels);
+        size_t n = drwav_read_pcm_frames_f32(&wav, frames, scratch.data());
+        mixToMono(scratch.data(), channels, n, out);
+        return n;
+    }
+};
+
+struct FlacDecoder : SampleDecoder {
+    drflac* flac = NULL;
+    std::vector<float> scratch;
+
+    ~FlacDecoder() {
+        if (flac) drflac_close(flac);
+    }
+
+    bool open(const std::string& path) {
+        flac = drflac_open_file(path.c_str(), NULL);
+        if (!flac) return false;
+        sampleRate = flac->sampleRate;
+        channels = flac->channels;
+        length = flac->totalPCMFrameCount;
+        return channels > 0;
+    }
+
+    size_t read(float* out, size_t frames) override {
+        scratch.resize(frames * channels);
+        size_t n = drflac_read_pcm_frames_f32(flac, frames, scratch.data());
+        mixToMono(scratch.data(), channels, n, out);
+        return n;
+    }
+};
+
+// minimp3 is built with its default 16-bit output, so this converts
+struct Mp3Decoder : SampleDecoder {
+    mp3dec_ex_t mp3;
+    bool opened = false;
+    std::vector<mp3d_sample_t> pcm;
+    std::vector<float> scratch;
+
+    ~Mp3Decoder() {
+        if (opened) mp3dec_ex_close(&mp3);
+    }
+
+    bool open(const std::string& path) {
+        // Seek mode scans the frame headers, which gives the exact length
+        opened = mp3dec_ex_open(&mp3, path.c_str(), MP3D_SEEK_TO_SAMPLE) == 0;
+        if (!opened) return false;
+        sampleRate = mp3.info.hz;
+        channels = mp3.info.channels;
+        if (channels == 0) return false;
+        length = mp3.samples / channels;
+        return true;
+    }
+
+    size_t read(float* out, size_t frames) override {
+        pcm.resize(frames * channels);
+        scratch.resize(frames * channels);
+        size_t n = mp3dec_ex_read(&mp3, pcm.data(), frames * channels) / channels;
+        for (size_t i = 0; i < n * channels; i++) {
+            scratch[i] = pcm[i] / 32768.f;
+        }
+        mixToMono(scratch.data(), channels, n, out);
+        return n;
+    }
+};
+
+static std::string getLowercaseExtension(const std::string& path) {
+    std::string extension = rack::system::getExtension(path);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    return extension;
+}
+
+template <typename T>
+static std::unique_ptr<SampleDecoder> openDecoder(const std::string& path) {
+    std::unique_ptr<T> decoder(new T);
+    if (!decoder->open(path)) return nullptr;
+    return decoder;
+}
+
+std::unique_ptr<SampleDecoder> SampleDecoder::open(const std::string& path) {
+    std::string extension = getLowercaseExtension(path);
+    if (extension == ".wav" || extension == ".aif" || extension == ".aiff") return openDecoder<WavDecoder>(path);
+    if (extension == ".flac") return openDecoder<FlacDecoder>(path);
+    if (extension == ".mp3") return openDecoder<Mp3Decoder>(path);
+    return nullptr;
+}
+
+bool isSupportedSampleFile(const std::string& path) {
+    std::string extension = getLowercaseExtension(path);
+    for (const char* supported : {".wav", ".aif", ".aiff", ".flac", ".mp3"}) {
+        if (extension == supported) return true;
+    }
+    return false;
+}
+
+SampleLoadPool& SampleLoadPool::get() {
+    static SampleLoadPool pool;
+    return pool;
+}
+
+SampleLoadPool::~SampleLoadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    upkeepWake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (upkeepThread.joinable()) upkeepThread.join();
+}
+
+std::shared_ptr<SampleLoadPool::Job> SampleLoadPool::submit(const void* owner, std::function<void(const Job&)> work, int priority) {
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->work = std::move(work);
+    job->owner = owner;
+    job->priority = priority;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+        // Started on first use
+        if (workers.empty()) {
+            unsigned int count = std::max(1u, std::min(MAX_WORKERS, std::thread::hardware_concurrency() / 2));
+            for (unsigned int i = 0; i < count; i++) {
+                workers.emplace_back(&SampleLoadPool::run, this);
+            }
+        }
+    }
+    queued.notify_one();
+    return job;
+}
+
+void SampleLoadPool::cancel(const std::shared_ptr<Job>& job) {
+    if (!job) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    job->cancelled = true;
+    if (job->state == Job::PENDING) {
+        job->state = Job::CANCELLED;
+        jobs.erase(std::remove(jobs.begin(), jobs.end(), job), jobs.end());
+        finished.notify_all();
+    }
+}
+
+void SampleLoadPool::cancelAll(const void* owner) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto owned = [&](const std::shared_ptr<Job>& job) { return job->owner == owner; };
+    for (const std::shared_ptr<Job>& job : jobs) {
+        if (owned(job)) job->state = Job::CANCELLED;
+    }
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), owned), jobs.end());
+    finished.notify_all();
+    for (const std::shared_ptr<Job>& job : running) {
+        if (owned(job)) job->cancelled = true;
+    }
+    upkeeps.erase(std::remove_if(upkeeps.begin(), upkeeps.end(), [&](const Upkeep& u) { return u.owner == owner; }), upkeeps.end());
+    finished.wait(lock, [&]() { return std::none_of(running.begin(), running.end(), owned) && upkeepOwner != owner; });
+}
+
+void SampleLoadPool::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]() { return jobs.empty() && running.empty(); });
+}
+
+void SampleLoadPool::addUpkeep(const void* owner, std::function<void()> work) {
+    std::lock_guard<std::mutex> lock(mutex);
+    upkeeps.push_back({owner, std::move(work)});
+    if (!upkeepThread.joinable()) {
+        upkeepThread = std::thread(&SampleLoadPool::runUpkeep, this);
+    }
+}
+
+void SampleLoadPool::runUpkeep() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        upkeepWake.wait_for(lock, std::chrono::milliseconds(UPKEEP_MS), [&]() { return stopping; });
+        if (stopping) return;
+        // Indexed, since cancelAll can remove entries while one runs. An
+        // entry skipped or repeated that way is picked up next time.
+        for (size_t i = 0; i < upkeeps.size(); i++) {
+            Upkeep upkeep = upkeeps[i];
+            upkeepOwner = upkeep.owner;
+            lock.unlock();
+            upkeep.work();
+            lock.lock();
+            upkeepOwner = nullptr;
+            finished.notify_all();
+        }
+    }
+}
+
+void SampleLoadPool::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queued.wait(lock, [&]() { return stopping || !jobs.empty(); });
+        if (stopping) return;
+
+        auto next = std::max_element(jobs.begin(), jobs.end(), [](const std::shared_ptr<Job>& a, const std::shared_ptr<Job>& b) {
+            return a->priority < b->priority;
+        });
+        std::shared_ptr<Job> job = *next;
+        jobs.erase(next);
+        job->state = Job::RUNNING;
+        running.push_back(job);
+
+        lock.unlock();
+        job->work(*job);
+        lock.lock();
+
+        running.erase(std::find(running.begin(), running.end(), job));
+        job->state = Job::DONE;
+        finished.notify_all();
+    }
+}
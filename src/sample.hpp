@@ -0,0 +1,186 @@
+#pragma once
+#include "plugin.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+// --- COMPACT SAMPLE STORAGE ---
+// Samples can be held as 16-bit integers or IEEE half floats instead of
+// float, halving their memory. Readers convert on the fly with
+// sampleToFloat; int16 values come back unscaled, so callers multiply by
+// their full scale / 32767 once, after mixing.
+
+// IEEE 754 binary16, kept as raw bits
+struct Half {
+    uint16_t bits;
+};
+
+inline float sampleToFloat(float v) {
+    return v;
+}
+
+inline float sampleToFloat(int16_t v) {
+    return (float)v;
+}
+
+inline float sampleToFloat(Half h) {
+#ifdef __F16C__
+    return _cvtsh_ss(h.bits);
+#else
+    // Move exponent and mantissa into float position and rebias by 2^112.
+    // Exact for normals and subnormals; audio never holds Inf or NaN.
+    uint32_t bits = (uint32_t)(h.bits & 0x7fff) << 13;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    f *= 0x1p112f;
+    std::memcpy(&bits, &f, sizeof(bits));
+    bits |= (uint32_t)(h.bits & 0x8000) << 16;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+#endif
+}
+
+// Inverse of sampleToFloat, rounding to nearest. Round trips are exact.
+inline void storeSample(float& out, float v) {
+    out = v;
+}
+
+inline void storeSample(int16_t& out, float v) {
+    out = (int16_t)std::lrint(std::max(-32768.f, std::min(v, 32767.f)));
+}
+
+inline void storeSample(Half& out, float v) {
+    uint32_t x;
+    std::memcpy(&x, &v, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = x & 0x7fffff;
+    if (exponent >= 31) {
+        // Overflow saturates to infinity
+        out.bits = sign | 0x7c00;
+    }
+    else if (exponent <= 0) {
+        // Subnormal, or zero once it is shifted out entirely
+        if (exponent < -10) {
+            out.bits = sign;
+            return;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t h = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) h++;
+        out.bits = sign | h;
+    }
+    else {
+        // A mantissa carry rolls correctly into the exponent
+        uint32_t h = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000) h++;
+        out.bits = sign | h;
+    }
+}
+
+// Writes mono 16-bit PCM through dr_wav, half the size of float. Samples are
+// divided by fullScale and clipped to +-1 first.
+bool saveWavMono(const std::string& path, const float* data, size_t length, unsigned int sampleRate, float fullScale = 1.f);
+
+// Streams a WAV, AIFF, FLAC or MP3 file as mono float frames a chunk at a
+// time, so callers can convert straight into their own storage instead of
+// holding the whole file as float first.
+struct SampleDecoder {
+    unsigned int sampleRate = 0;
+    unsigned int channels = 0;
+    // Total frames, known up front for every supported format
+    size_t length = 0;
+
+    virtual ~SampleDecoder() {}
+    // Decodes up to `frames` frames, mixed down to mono from the first two
+    // channels. Returns fewer at the end of the file or on a decode error.
+    virtual size_t read(float* out, size_t frames) = 0;
+
+    // Picks the decoder by extension. Returns NULL if the file is not a
+    // supported type or cannot be opened.
+    static std::unique_ptr<SampleDecoder> open(const std::string& path);
+};
+
+// True if SampleDecoder::open handles the file's extension
+bool isSupportedSampleFile(const std::string& path);
+
+// Small pool of decoder threads shared by every module, so opening a patch
+// with many samples neither blocks the UI nor starts a thread per module.
+// The highest priority pending job runs first; a module can raise its job's
+// priority while it waits, e.g. once it is on screen or patched.
+struct SampleLoadPool {
+    struct Job {
+        enum State { PENDING, RUNNING, DONE, CANCELLED };
+
+        std::function<void(const Job&)> work;
+        // The submitting module, for cancelAll
+        const void* owner = nullptr;
+        std::atomic<int> priority{0};
+        // Set by cancel. Long jobs poll it and return early.
+        std::atomic<bool> cancelled{false};
+        std::atomic<State> state{PENDING};
+
+        bool isFinished() const {
+            State s = state;
+            return s == DONE || s == CANCELLED;
+        }
+    };
+
+    static SampleLoadPool& get();
+    ~SampleLoadPool();
+
+    std::shared_ptr<Job> submit(const void* owner, std::function<void(const Job&)> work, int priority = 0);
+    // Never blocks: drops a job that has not started and flags one that is
+    // running. A cancelled job may still finish, so its results must be
+    // checked for staleness where they land.
+    void cancel(const std::shared_ptr<Job>& job);
+    // Cancels every job of `owner` and waits for the running ones, so none
+    // outlives it. For destructors.
+    void cancelAll(const void* owner);
+    // Waits until no job is pending or running. For offline hosts, which
+    // need a load to land before they render.
+    void waitIdle();
+    // Runs `work` on the pool's upkeep thread every UPKEEP_MS until
+    // cancelAll(owner), for housekeeping that must not wait for a widget
+    // to be stepped, e.g. in a headless host.
+    void addUpkeep(const void* owner, std::function<void()> work);
+
+    static const int UPKEEP_MS = 20;
+    // Decoding is mostly disk and memory bound, so a few threads are enough
+    static const unsigned int MAX_WORKERS = 4;
+
+private:
+    struct Upkeep {
+        const void* owner;
+        std::function<void()> work;
+    };
+
+    void run();
+    void runUpkeep();
+
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable finished;
+    std::vector<std::shared_ptr<Job>> jobs;
+    std::vector<std::shared_ptr<Job>> running;
+    std::vector<std::thread> workers;
+    std::vector<Upkeep> upkeeps;
+    std::thread upkeepThread;
+    std::condition_variable upkeepWake;
+    // Owner of the upkeep running now, for cancelAll
+    const void* upkeepOwner = nullptr;
+    bool stopping = false;
+};